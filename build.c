@@ -4,8 +4,28 @@
 
 #define APP_NAME "sfs"
 
+// NOTE(felix): converts every SVG in the corpus, for `pgo` builds
+static u32 train(Arena arena, Slice_String program_command, String build_directory) {
+    Slice_String names = os_list_directory(&arena, "svgs");
+    u32 exit_code = names.count == 0;
+
+    for_slice (String *, name, names) {
+        if (!string_ends_with(*name, string(".svg"))) continue;
+        String stem = string_range(*name, 0, name->count - string(".svg").count);
+
+        Array_String command = { .arena = &arena };
+        push_slice(&command, program_command);
+        push(&command, string_print(&arena, "../svgs/%S", *name));
+        push(&command, string_print(&arena, "pgo/%S.swf", stem));
+
+        exit_code |= os_process_run(arena, command.slice, build_directory, Os_Process_Flag_PRINT_COMMAND_BEFORE_RUNNING | Os_Process_Flag_PRINT_EXIT_CODE);
+    }
+
+    return exit_code;
+}
+
 static void program(void) {
     Arena arena = arena_init(64 * 1024 * 1024);
-    u32 exit_code = build_default_everything(arena, string(APP_NAME), BASE_OS);
+    u32 exit_code = build_default_everything(arena, string(APP_NAME), BASE_OS, train);
     os_exit(exit_code);
 }
@@ -16,3 +16,7 @@ zig cc -target x86_64-macos -std=c11 -fms-extensions -Wno-microsoft -Wno-assume
 zig cc -target aarch64-macos -std=c11 -fms-extensions -Wno-microsoft -Wno-assume ^
     -O2 -DLINK_CRT=1 src/main.c ^
     -obin/sfs-macos-aarch64.bin
+
+zig cc -target x86_64-linux-gnu -std=c11 -fms-extensions -Wno-microsoft -Wno-assume ^
+    -O2 -DLINK_CRT=1 src/main.c -lm -lpthread ^
+    -obin/sfs-linux-x86_64.bin
@@ -4,6 +4,11 @@
 
 #include "base_context.h"
 
+#if BASE_OS == BASE_OS_LINUX && !defined(_DEFAULT_SOURCE)
+    // NOTE(felix): glibc hides POSIX functions like realpath() and lstat() under -std=c11 unless asked for them before the first system header
+    #define _DEFAULT_SOURCE
+#endif
+
 #include <stdint.h> // TODO(felix): look into removing
 #include <stddef.h> // TODO(felix): look into removing
 #include <stdarg.h> // NOTE(felix): doesn't seem like anything can be done about this one
@@ -20,6 +25,10 @@
     #include <unistd.h>
     #include <sys/stat.h>
     #include <sys/wait.h>
+    #include <sys/mman.h>
+    #include <dirent.h>
+    #include <time.h>
+    #include <pthread.h>
     #define os_exit(code) _exit(code)
     #define os_abort() abort()
     extern int errno;
@@ -27,12 +36,23 @@
 #elif BASE_OS == BASE_OS_LINUX
     #define static_assert _Static_assert
     void exit(int); // TODO(felix): can remove?
+    #define os_exit(code) exit(code)
     void abort(void); // TODO(felix): own implementation to not depend on libc
+    #define os_abort() abort()
+    void *malloc(size_t bytes); // TODO(felix): remove once using virtual alloc arena
     void *calloc(size_t item_count, size_t item_size); // TODO(felix): remove once using virtual alloc arena
     void free(void *pointer); // TODO(felix): remove once using virtual alloc arena
+    char *realpath(const char *file_name, char *resolved_name);
     // TODO(felix): which of these can be removed in favour of doing direct syscalls?
-        #include <fcntl.h>
-        #include <unistd.h>
+    #include <errno.h> // NOTE(felix): glibc's errno is a macro for a thread-local, so it can't be declared extern like on macOS
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <sys/mman.h>
+    #include <dirent.h>
+    #include <time.h>
+    #include <pthread.h>
     #include <stdio.h> // TODO(felix): only needed for FILE. remove!
 #elif BASE_OS == BASE_OS_MACOS
     #define static_assert _Static_assert
@@ -51,6 +71,10 @@
     char *realpath(const char *file_name, char *resolved_name);
     extern int errno;
     #include <sys/wait.h>
+    #include <sys/mman.h>
+    #include <dirent.h>
+    #include <time.h>
+    #include <pthread.h>
 #elif BASE_OS == BASE_OS_WINDOWS
     #define static_assert _Static_assert
     #define WIN32_LEAN_AND_MEAN
@@ -68,6 +92,7 @@
 #if COMPILER_CLANG || COMPILER_GCC // they share many builtins
     #define builtin_unreachable __builtin_unreachable()
     #define force_inline inline __attribute__((always_inline))
+    #define thread_local _Thread_local
     // TODO(felix): this is only for memcmp, etc. fix!
     #include <string.h>
 #endif
@@ -85,6 +110,7 @@
     #define breakpoint __debugbreak()
     #define builtin_unreachable assert(false)
     #define force_inline inline __forceinline
+    #define thread_local __declspec(thread)
 
 #elif COMPILER_STANDARD
     // NOTE(felix): I don't even know why I have this. Getting my base layer working with a non-major compiler is not a priority
@@ -93,6 +119,7 @@
     #define breakpoint builtin_assume(false)
     #define builtin_unreachable assert(false)
     #define force_inline inline
+    #define thread_local _Thread_local
 
 #endif // COMPILER
 
@@ -399,6 +426,7 @@ uniondef(M4) {
 };
 
 #define pi_f32 3.14159265358979f
+#define pi_f64 3.14159265358979323846
 
 // TODO(felix): use C11 generics for generic abs()
 #if COMPILER_MSVC
@@ -422,6 +450,56 @@ uniondef(M4) {
     #define count_trailing_zeroes(x) (u64)(__builtin_ctzll(x))
 #endif
 
+// NOTE(felix): sequentially consistent unless the name says otherwise. Each returns the value from before the operation
+#if COMPILER_MSVC
+    #define atomic_add_u32(pointer, value) (u32)_InterlockedExchangeAdd((volatile long *)(pointer), (long)(value))
+    #define atomic_add_u64(pointer, value) (u64)_InterlockedExchangeAdd64((volatile i64 *)(pointer), (i64)(value))
+    #define atomic_load_acquire_u64(pointer) (u64)_InterlockedOr64((volatile i64 *)(pointer), 0)
+    #define atomic_store_release_u64(pointer, value) (void)_InterlockedExchange64((volatile i64 *)(pointer), (i64)(value))
+#elif COMPILER_CLANG || COMPILER_GCC
+    #define atomic_add_u32(pointer, value) __atomic_fetch_add((u32 *)(pointer), (u32)(value), __ATOMIC_SEQ_CST)
+    #define atomic_add_u64(pointer, value) __atomic_fetch_add((u64 *)(pointer), (u64)(value), __ATOMIC_SEQ_CST)
+    #define atomic_load_acquire_u64(pointer) __atomic_load_n((u64 *)(pointer), __ATOMIC_ACQUIRE)
+    #define atomic_store_release_u64(pointer, value) __atomic_store_n((u64 *)(pointer), (u64)(value), __ATOMIC_RELEASE)
+#endif
+
+// NOTE(felix): for choosing between variants of a kernel at runtime. Variants for an instruction set are marked with its target_ attribute, so that the rest of the program doesn't need to be compiled for it.
+// Only call a variant if cpu_isa_supported() is at least its Cpu_Isa
+typedef enum Cpu_Isa {
+    Cpu_Isa_SCALAR,
+    Cpu_Isa_SSE2,
+    Cpu_Isa_AVX2,
+    Cpu_Isa_AVX512, // F and BW
+    Cpu_Isa_COUNT,
+} Cpu_Isa;
+
+static const char *cpu_isa_names[Cpu_Isa_COUNT] = {
+    [Cpu_Isa_SCALAR] = "scalar",
+    [Cpu_Isa_SSE2] = "sse2",
+    [Cpu_Isa_AVX2] = "avx2",
+    [Cpu_Isa_AVX512] = "avx512",
+};
+
+static Cpu_Isa cpu_isa_supported(void);
+
+#if ARCH_X64
+    #if COMPILER_MSVC
+        #include <intrin.h>
+    #else
+        #include <immintrin.h>
+    #endif
+#endif
+
+#if ARCH_X64 && (COMPILER_CLANG || COMPILER_GCC)
+    #define target_sse2 __attribute__((target("sse2")))
+    #define target_avx2 __attribute__((target("avx2")))
+    #define target_avx512 __attribute__((target("avx512f,avx512bw")))
+#else
+    #define target_sse2
+    #define target_avx2
+    #define target_avx512
+#endif
+
 static bool intersect_point_in_rectangle(V2 point, V4 rectangle);
 static bool is_power_of_2(u64 x);
 
@@ -486,6 +564,7 @@ static force_inline M3 m3_fill_diagonal(f32 value);
 static       inline M3 m3_from_rotation(f32 radians, V2 pivot);
 static       inline M3 m3_inverse(M3 m);
 static       inline M3 m3_model(V2 scale, f32 radians, V2 pivot, V2 post_translation);
+static       inline M3 m3_mul_m3(M3 a, M3 b);
 static       inline V3 m3_mul_v3(M3 m, V3 v);
 static       inline M3 m3_transpose(M3 m);
 
@@ -530,6 +609,8 @@ static   String string_print_(Arena *arena, const char *fmt, va_list arguments);
 static   String string_print(Arena *arena, const char *fmt, ...);
 static   String string_range(String string, u64 start, u64 end);
 static     bool string_starts_with(String s, String start);
+static     bool string_ends_with(String s, String end);
+static   String string_trim_whitespace(String s);
 
 static void string_builder_print(String_Builder *builder, const char* format, ...);
 static void string_builder_print_(String_Builder *builder, const char *fmt, va_list arguments);
@@ -544,13 +625,24 @@ structdef(Os_File_Info) {
     // TODO(felix): creation, modification, and access time
 };
 
+typedef enum Os_Stream {
+    Os_Stream_OUTPUT,
+    Os_Stream_ERROR,
+} Os_Stream;
+
 static Os_File_Info  os_file_info(const char *relative_path);
 static         void *os_heap_allocate(u64 byte_count);
 static         void  os_heap_free(void *pointer);
+static Slice_String  os_list_directory(Arena *arena, const char *relative_path);
 static         bool  os_make_directory(const char *relative_path, u32 mode);
+static       String  os_map_entire_file(Arena *arena, const char *relative_path);
+static         void  os_unmap_file(Arena *arena, String view);
 static       String  os_read_entire_file(Arena *arena, const char *relative_path, u64 max_bytes);
+static       String  os_read_standard_input(Arena *arena);
 static         void  os_remove_file(const char *relative_path);
+static          u64  os_time_microseconds(void);
 static         void  os_write(String bytes);
+static         bool  os_write_stream(Os_Stream stream, String bytes);
 static         bool  os_write_entire_file(const char *relative_path, String bytes);
 
 #define log_info(...) log_internal("info: " __VA_ARGS__)
@@ -565,6 +657,21 @@ static u32 os_process_run(Arena arena, Slice_String arguments, String directory,
 
 static void print(const char *format, ...);
 static void print_(const char *format, va_list arguments);
+static void print_stream(Os_Stream stream, const char *format, ...);
+static void print_stream_(Os_Stream stream, const char *format, va_list arguments);
+
+typedef void Os_Thread_Function(void *parameter);
+structdef(Os_Thread) {
+    #if BASE_OS == BASE_OS_WINDOWS
+        HANDLE handle;
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        pthread_t handle;
+    #endif
+};
+
+static Os_Thread os_thread_start(Os_Thread_Function *function, void *parameter);
+static      void os_thread_join(Os_Thread thread);
+static       u32 os_cpu_count(void);
 
 typedef enum {
     Build_Compiler_MSVC,
@@ -579,7 +686,10 @@ typedef enum {
     Build_Mode_COUNT,
 } Build_Mode;
 
-static u32 build_default_everything(Arena arena, String program_name, u8 target_os);
+// NOTE(felix): exercises the program for profile-guided optimisation. `program_command` runs the program from `build_directory`; return 0 on success
+typedef u32 Build_Training_Function(Arena arena, Slice_String program_command, String build_directory);
+
+static u32 build_default_everything(Arena arena, String program_name, u8 target_os, Build_Training_Function *training);
 
 enumdef(App_Key, u8) {
     App_Key_NIL = 0,
@@ -993,6 +1103,10 @@ static inline bool ascii_is_alpha(u8 c) { return ('A' <= c && c <= 'Z') || ('a'
 
 static inline bool ascii_is_decimal(u8 c) { return '0' <= c && c <= '9'; }
 
+static inline bool ascii_is_lower(u8 c) { return 'a' <= c && c <= 'z'; }
+
+static inline u8 ascii_to_upper(u8 c) { return ascii_is_lower(c) ? (u8)(c - 'a' + 'A') : c; }
+
 static inline bool ascii_is_hexadecimal(u8 c) { return ('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f'); }
 
 static inline bool ascii_is_whitespace(u8 c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
@@ -1028,7 +1142,11 @@ static void *arena_make_(Arena *arena, u64 item_count, u64 item_size, const char
 
     if (arena->capacity == 0) *arena = arena_init(8 * 1024 * 1024);
 
-    if (arena->offset + byte_count > arena->capacity) panic("allocation failure");
+    // NOTE(felix): arenas don't grow yet (see arena_init), so running out is a limit of the input's size rather than a bug
+    if (arena->offset + byte_count > arena->capacity) {
+        log_error("out of memory: %llu more bytes needed, but an arena of %llu has only %llu left", byte_count, arena->capacity, arena->capacity - arena->offset);
+        os_exit(1);
+    }
 
     void *mem = (u8 *)arena->mem + arena->offset;
     arena->last_offset = arena->offset;
@@ -1097,8 +1215,16 @@ static u64 hash_lookup_msi(u64 hash, u64 exponent, u64 index) {
 )
 
 static void map_make_explicit_item_size(Arena *arena, Map_void *map, u64 capacity, u64 item_size) {
+    // NOTE(felix): room for `capacity` items, plus the unused index 0, without going over the load factor
+    capacity += 2;
     capacity *= 100;
     capacity /= MAP_MAX_LOAD_FACTOR;
+    capacity += 1;
+
+    // NOTE(felix): lookups mask with the capacity, so every table must be the same power of 2
+    u64 power_of_2 = 2;
+    while (power_of_2 < capacity) power_of_2 *= 2;
+    capacity = power_of_2;
 
     map->arena = arena;
     reserve_explicit_item_size(&map->values, capacity, item_size, false);
@@ -1106,6 +1232,7 @@ static void map_make_explicit_item_size(Arena *arena, Map_void *map, u64 capacit
     map->count = 1;
     map->keys = arena_make_(map->arena, capacity, sizeof *map->keys, __FILE__, __LINE__, __func__);
     map->value_index_from_key_hash = arena_make_(map->arena, capacity, sizeof *map->value_index_from_key_hash, __FILE__, __LINE__, __func__);
+    memset(map->value_index_from_key_hash, 0, capacity * sizeof *map->value_index_from_key_hash);
 }
 
 static Map_Result map_get_(Map_void *map, u64 key, void *put, u64 item_size) {
@@ -1412,6 +1539,16 @@ static inline M3 m3_model(V2 scale, f32 radians, V2 pivot, V2 post_translation)
     return result;
 }
 
+static inline M3 m3_mul_m3(M3 a, M3 b) {
+    M3 result = {0};
+    for (int col = 0; col < 3; col += 1) for (int row = 0; row < 3; row += 1) {
+        f32 sum = 0;
+        for (int pos = 0; pos < 3; pos += 1) sum += a.c[pos][row] * b.c[col][pos];
+        result.c[col][row] = sum;
+    }
+    return result;
+}
+
 static inline V3 m3_mul_v3(M3 m, V3 v) {
     return (V3){
         .x = v3_dot(v, (V3){ .x = m.c[0][0], .y = m.c[0][1], .z = m.c[0][2] }),
@@ -1577,14 +1714,8 @@ static f64 f64_from_string(String s) {
     f64 decimal_part = 0;
     if (decimal_index != s.count) {
         String decimal_string = slice_range(s, decimal_index + 1, s.count);
-        u64 digit_count = decimal_string.count;
-        for (i64 i = (i64)decimal_string.count; i >= 0; i -= 1) {
-            bool trailing_zero = decimal_string.data[i] == 0;
-            digit_count -= trailing_zero;
-            if (!trailing_zero) break;
-        }
         decimal_part = (f64)int_from_string_base(decimal_string, 10);
-        for (u64 i = 0; i < digit_count; i += 1) decimal_part *= 0.1;
+        for (u64 i = 0; i < decimal_string.count; i += 1) decimal_part *= 0.1;
     }
 
     result = int_part + decimal_part;
@@ -1673,6 +1804,17 @@ static bool string_starts_with(String s, String start) {
     return true;
 }
 
+static bool string_ends_with(String s, String end) {
+    if (s.count < end.count) return false;
+    return string_starts_with(string_range(s, s.count - end.count, s.count), end);
+}
+
+static String string_trim_whitespace(String s) {
+    while (s.count > 0 && ascii_is_whitespace(s.data[0])) s.data += 1, s.count -= 1;
+    while (s.count > 0 && ascii_is_whitespace(s.data[s.count - 1])) s.count -= 1;
+    return s;
+}
+
 static void string_builder_print(String_Builder *builder, const char *fmt_c, ...) {
     va_list arguments;
     va_start(arguments, fmt_c);
@@ -1935,6 +2077,50 @@ static Os_File_Info os_file_info(const char *relative_path) {
     return info;
 }
 
+// NOTE(felix): the names of the directory's entries, not including "." and "..", in no particular order
+static Slice_String os_list_directory(Arena *arena, const char *relative_path) {
+    Array_String names = { .arena = arena };
+
+    #if BASE_OS == BASE_OS_WINDOWS
+    {
+        Scratch scratch = scratch_begin(arena);
+        const char *pattern = (const char *)string_print(scratch.arena, "%s\\*\0", relative_path).data;
+
+        WIN32_FIND_DATAA entry = {0};
+        HANDLE handle = FindFirstFileA(pattern, &entry);
+        if (handle == INVALID_HANDLE_VALUE) log_error("unable to list directory '%s'", relative_path);
+        else {
+            do {
+                String name = string_from_cstring(entry.cFileName);
+                if (string_equals(name, string(".")) || string_equals(name, string(".."))) continue;
+                push(&names, string_print(arena, "%S", name));
+            } while (FindNextFileA(handle, &entry));
+            FindClose(handle);
+        }
+
+        scratch_end(scratch);
+    }
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+    {
+        DIR *directory = opendir(relative_path);
+        if (directory == 0) log_error("unable to list directory '%s' (errno=%d)", relative_path, errno);
+        else {
+            for (struct dirent *entry = readdir(directory); entry != 0; entry = readdir(directory)) {
+                String name = string_from_cstring(entry->d_name);
+                if (string_equals(name, string(".")) || string_equals(name, string(".."))) continue;
+                push(&names, string_print(arena, "%S", name));
+            }
+            closedir(directory);
+        }
+    }
+    #else
+        (void)relative_path;
+        panic("unimplemented");
+    #endif
+
+    return names.slice;
+}
+
 static bool os_make_directory(const char *relative_path, u32 mode) {
     bool ok = false;
 
@@ -1966,6 +2152,95 @@ static bool os_make_directory(const char *relative_path, u32 mode) {
     return ok;
 }
 
+#if BASE_OS & BASE_OS_ANY_POSIX
+// NOTE(felix): pipes can't be sized up front, so read in ever larger steps until there is nothing left. Empty on failure
+static String os_read_until_end_(Arena *arena, int file) {
+    Array_u8 bytes = { .arena = arena };
+    while (true) {
+        reserve(&bytes, bytes.count + 64 * 1024);
+        i64 read_this_time = read(file, bytes.data + bytes.count, bytes.capacity - bytes.count);
+        if (read_this_time == -1) return (String){0};
+        if (read_this_time == 0) break;
+        bytes.count += (u64)read_this_time;
+    }
+    return bit_cast(String) bytes;
+}
+#endif
+
+// NOTE(felix): a read-only view of the file, mapped rather than copied when it can be. The view lasts until os_unmap_file(), or until the process exits.
+// Anything that can't be mapped, like a pipe or an empty file, is read into `arena` instead
+static String os_map_entire_file(Arena *arena, const char *relative_path) {
+    if (relative_path == 0 || *relative_path == 0) return (String){0};
+
+    String view = {0};
+
+    #if BASE_OS == BASE_OS_WINDOWS
+        HANDLE file = CreateFileA(relative_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+        if (file == INVALID_HANDLE_VALUE) {
+            log_error("unable to open file '%s'", relative_path);
+            return view;
+        }
+
+        LARGE_INTEGER file_size = {0};
+        bool mappable = GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0;
+        if (mappable) {
+            HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+            if (mapping != 0) {
+                view.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view.data != 0) view.count = (u64)file_size.QuadPart;
+
+                // NOTE(felix): the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(file);
+        if (view.data == 0) view = os_read_entire_file(arena, relative_path, 0);
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        int file = open(relative_path, O_RDONLY);
+        if (file == -1) {
+            log_error("unable to open file '%s'", relative_path);
+            return view;
+        }
+
+        struct stat info = {0};
+        bool mappable = fstat(file, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0;
+        if (mappable) {
+            void *memory = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (memory != MAP_FAILED) {
+                madvise(memory, (size_t)info.st_size, MADV_SEQUENTIAL);
+                view = (String){ .data = memory, .count = (u64)info.st_size };
+            }
+        }
+
+        if (view.data == 0) {
+            view = os_read_until_end_(arena, file);
+            if (view.count == 0) log_error("unable to read file '%s'", relative_path);
+        }
+
+        close(file);
+    #else
+        #error "unsupported OS"
+    #endif
+
+    return view;
+}
+
+// NOTE(felix): gives back a view from os_map_entire_file() with the same `arena`, unless it was read into the arena instead
+static void os_unmap_file(Arena *arena, String view) {
+    if (view.data == 0) return;
+    u8 *arena_begin = arena->mem;
+    if (view.data >= arena_begin && view.data < arena_begin + arena->capacity) return;
+
+    #if BASE_OS == BASE_OS_WINDOWS
+        UnmapViewOfFile(view.data);
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        munmap(view.data, (size_t)view.count);
+    #else
+        #error "unsupported OS"
+    #endif
+}
+
 static String os_read_entire_file(Arena *arena, const char *relative_path, u64 max_bytes) {
     if (max_bytes == 0) max_bytes = UINT32_MAX;
 
@@ -2059,6 +2334,32 @@ static String os_read_entire_file(Arena *arena, const char *relative_path, u64 m
     return bit_cast(String) bytes;
 }
 
+static String os_read_standard_input(Arena *arena) {
+    #if BASE_OS == BASE_OS_WINDOWS
+        HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+        if (input == INVALID_HANDLE_VALUE || input == 0) return (String){0};
+
+        Array_u8 bytes = { .arena = arena };
+        while (true) {
+            reserve(&bytes, bytes.count + 64 * 1024);
+            DWORD to_read = (DWORD)MIN(bytes.capacity - bytes.count, UINT32_MAX);
+            DWORD read_this_time = 0;
+            BOOL ok = ReadFile(input, bytes.data + bytes.count, to_read, &read_this_time, 0);
+
+            // NOTE(felix): a pipe reports its end as a broken pipe rather than a read of 0 bytes
+            if (!ok && GetLastError() == ERROR_BROKEN_PIPE) break;
+            if (!ok) return (String){0};
+            if (read_this_time == 0) break;
+            bytes.count += read_this_time;
+        }
+        return bit_cast(String) bytes;
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        return os_read_until_end_(arena, 0);
+    #else
+        #error "unsupported OS"
+    #endif
+}
+
 static void os_remove_file(const char *relative_path) {
     #if BASE_OS == BASE_OS_WINDOWS
     {
@@ -2081,6 +2382,24 @@ static void os_remove_file(const char *relative_path) {
     #endif
 }
 
+static u64 os_time_microseconds(void) {
+    #if BASE_OS == BASE_OS_WINDOWS
+        static LARGE_INTEGER frequency;
+        if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+        LARGE_INTEGER counter = {0};
+        QueryPerformanceCounter(&counter);
+        u64 seconds = (u64)(counter.QuadPart / frequency.QuadPart);
+        u64 remainder = (u64)(counter.QuadPart % frequency.QuadPart);
+        return seconds * 1000000 + remainder * 1000000 / (u64)frequency.QuadPart;
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        struct timespec now = {0};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (u64)now.tv_sec * 1000000 + (u64)now.tv_nsec / 1000;
+    #else
+        #error "unsupported OS"
+    #endif
+}
+
 static bool os_write_entire_file(const char *relative_path, String bytes) {
     #if BASE_OS == BASE_OS_WINDOWS
         u64 dword_max = UINT32_MAX;
@@ -2133,14 +2452,15 @@ static bool os_write_entire_file(const char *relative_path, String bytes) {
 }
 
 static void log_internal_with_location(const char *file, u64 line, const char *func, const char *format, ...) {
+    // NOTE(felix): logs go to stderr, so that they don't end up mixed into output written to stdout
     va_list arguments;
     va_start(arguments, format);
-    print_(format, arguments);
+    print_stream_(Os_Stream_ERROR, format, arguments);
     va_end(arguments);
-    print("\n");
+    print_stream(Os_Stream_ERROR, "\n");
 
     #if BUILD_DEBUG
-        print("%s:%llu:%s(): logged here\n", file, line, func);
+        print_stream(Os_Stream_ERROR, "%s:%llu:%s(): logged here\n", file, line, func);
     #else
         (void)(file); (void)(line); (void)(func);
     #endif
@@ -2204,6 +2524,7 @@ static u32 os_process_run(Arena arena, Slice_String arguments, String directory,
         Slice_String args = arguments;
         char **argv = arena_make(scratch.arena, args.count + 1, char *);
         for (u64 i = 0; i < args.count; i += 1) argv[i] = cstring_from_string(scratch.arena, args.data[i]);
+        argv[args.count] = 0; // NOTE(felix): arena memory isn't zeroed when it is reused
 
         if (flags & Os_Process_Flag_PRINT_COMMAND_BEFORE_RUNNING) {
             if (directory.count != 0) print("[./%S] ", directory);
@@ -2250,27 +2571,36 @@ static u32 os_process_run(Arena arena, Slice_String arguments, String directory,
 }
 
 static void os_write(String string) {
-    // TODO(felix): stderr support
-    // NOTE(felix): can't use assert in this function because panic() will call os_write, so we'll end up with a recursively failing assert and stack overflow. Instead, use `if (!condition) { breakpoint; abort(); }`
+    os_write_stream(Os_Stream_OUTPUT, string);
+}
+
+// NOTE(felix): can't use assert in this function because panic() will call it, so we'll end up with a recursively failing assert and stack overflow
+static bool os_write_stream(Os_Stream stream, String string) {
     #if BASE_OS == BASE_OS_WINDOWS
         #if WINDOWS_SUBSYSTEM_WINDOWS
-            (void)(string);
+            (void)(stream); (void)(string);
+            return true;
         #else
-            if (string.count > UINT32_MAX) { breakpoint; os_abort(); }
+            if (string.count > UINT32_MAX) return false;
 
-            HANDLE console_handle = GetStdHandle(STD_OUTPUT_HANDLE);
-            if (console_handle == INVALID_HANDLE_VALUE) { breakpoint; os_abort(); }
+            HANDLE handle = GetStdHandle(stream == Os_Stream_ERROR ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
+            if (handle == INVALID_HANDLE_VALUE) return false;
 
             u32 num_chars_written = 0;
-            BOOL ok = WriteFile(console_handle, string.data, (u32)string.count, (LPDWORD)&num_chars_written, 0);
-            if (!ok) { breakpoint; os_abort(); }
-            if (num_chars_written != string.count) { breakpoint; os_abort(); }
+            BOOL ok = WriteFile(handle, string.data, (u32)string.count, (LPDWORD)&num_chars_written, 0);
+            return ok && num_chars_written == string.count;
         #endif
 
     #elif BASE_OS & BASE_OS_ANY_POSIX
-        int stdout_handle = 1;
-        i64 bytes_written = write(stdout_handle, string.data, string.count);
-        (void)(bytes_written);
+        int handle = stream == Os_Stream_ERROR ? 2 : 1;
+
+        // NOTE(felix): pipes take big writes a piece at a time
+        for (u64 written_bytes = 0; written_bytes < string.count;) {
+            i64 wrote_this_time = write(handle, string.data + written_bytes, string.count - written_bytes);
+            if (wrote_this_time == -1) return false;
+            written_bytes += (u64)wrote_this_time;
+        }
+        return true;
 
     #else
         #error "unimplemented"
@@ -2286,6 +2616,17 @@ static void print(const char *format, ...) {
 }
 
 static void print_(const char *format, va_list arguments) {
+    print_stream_(Os_Stream_OUTPUT, format, arguments);
+}
+
+static void print_stream(Os_Stream stream, const char *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    print_stream_(stream, format, arguments);
+    va_end(arguments);
+}
+
+static void print_stream_(Os_Stream stream, const char *format, va_list arguments) {
     // TODO(felix): this should use the thread_local arena once we add that system
     static Arena arena = {0};
     if (arena.mem == 0) arena = arena_init(8096);
@@ -2301,11 +2642,115 @@ static void print_(const char *format, va_list arguments) {
         OutputDebugStringA((char *)output.data);
     #endif
 
-    os_write(output.string);
+    os_write_stream(stream, output.string);
 
     scratch_end(temp);
 }
 
+structdef(Os_Thread_Start) {
+    Os_Thread_Function *function;
+    void *parameter;
+};
+
+#if BASE_OS == BASE_OS_WINDOWS
+    static DWORD WINAPI os_thread_entry(void *start_) {
+        Os_Thread_Start start = *(Os_Thread_Start *)start_;
+        os_heap_free(start_);
+        start.function(start.parameter);
+        return 0;
+    }
+#elif BASE_OS & BASE_OS_ANY_POSIX
+    static void *os_thread_entry(void *start_) {
+        Os_Thread_Start start = *(Os_Thread_Start *)start_;
+        os_heap_free(start_);
+        start.function(start.parameter);
+        return 0;
+    }
+#endif
+
+static Os_Thread os_thread_start(Os_Thread_Function *function, void *parameter) {
+    Os_Thread thread = {0};
+
+    // NOTE(felix): on the heap because the new thread may not read it before we return
+    Os_Thread_Start *start = os_heap_allocate(sizeof *start);
+    *start = (Os_Thread_Start){ .function = function, .parameter = parameter };
+
+    #if BASE_OS == BASE_OS_WINDOWS
+        thread.handle = CreateThread(0, 0, os_thread_entry, start, 0, 0);
+        if (thread.handle == 0) panic("unable to start thread; CreateThread() failed (error %u)", GetLastError());
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        int result = pthread_create(&thread.handle, 0, os_thread_entry, start);
+        if (result != 0) panic("unable to start thread; pthread_create() returned %d", result);
+    #else
+        #error "unsupported OS"
+    #endif
+
+    return thread;
+}
+
+static void os_thread_join(Os_Thread thread) {
+    #if BASE_OS == BASE_OS_WINDOWS
+        WaitForSingleObject(thread.handle, INFINITE);
+        CloseHandle(thread.handle);
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        pthread_join(thread.handle, 0);
+    #else
+        #error "unsupported OS"
+    #endif
+}
+
+static u32 os_cpu_count(void) {
+    #if BASE_OS == BASE_OS_WINDOWS
+        SYSTEM_INFO info = {0};
+        GetSystemInfo(&info);
+        u32 count = (u32)info.dwNumberOfProcessors;
+    #elif BASE_OS & BASE_OS_ANY_POSIX
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        u32 count = online > 0 ? (u32)online : 1;
+    #else
+        #error "unsupported OS"
+    #endif
+    return MAX(count, 1);
+}
+
+static Cpu_Isa cpu_isa_supported(void) {
+    Cpu_Isa isa = Cpu_Isa_SCALAR;
+
+    #if ARCH_X64
+        u32 leaf_1[4] = {0}, leaf_7[4] = {0}; // eax, ebx, ecx, edx
+        u64 os_saved_state = 0;
+        #if COMPILER_MSVC
+            __cpuidex((int *)leaf_1, 1, 0);
+            __cpuidex((int *)leaf_7, 7, 0);
+            bool os_saves_state = (leaf_1[2] >> 27) & 1;
+            if (os_saves_state) os_saved_state = _xgetbv(0);
+        #elif COMPILER_CLANG || COMPILER_GCC
+            __asm__ ("cpuid" : "=a"(leaf_1[0]), "=b"(leaf_1[1]), "=c"(leaf_1[2]), "=d"(leaf_1[3]) : "a"(1), "c"(0));
+            __asm__ ("cpuid" : "=a"(leaf_7[0]), "=b"(leaf_7[1]), "=c"(leaf_7[2]), "=d"(leaf_7[3]) : "a"(7), "c"(0));
+            bool os_saves_state = (leaf_1[2] >> 27) & 1;
+            if (os_saves_state) {
+                u32 low = 0, high = 0;
+                __asm__ ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+                os_saved_state = ((u64)high << 32) | low;
+            }
+        #endif
+
+        // NOTE(felix): every x86-64 CPU has SSE2. The wider sets also need the OS to save their registers on a context switch
+        isa = Cpu_Isa_SSE2;
+
+        bool avx = (leaf_1[2] >> 28) & 1;
+        bool os_saves_avx = (os_saved_state & 0x6) == 0x6;
+        bool avx2 = (leaf_7[1] >> 5) & 1;
+        if (avx && os_saves_avx && avx2) isa = Cpu_Isa_AVX2;
+
+        bool os_saves_avx512 = (os_saved_state & 0xe6) == 0xe6;
+        bool avx512 = ((leaf_7[1] >> 16) & 1) && ((leaf_7[1] >> 30) & 1);
+        if (isa == Cpu_Isa_AVX2 && os_saves_avx512 && avx512) isa = Cpu_Isa_AVX512;
+    #endif
+
+    return isa;
+}
+
 #define BUILD_FLAGS_MAX 16
 
 static String build_compiler_initial_command[Build_Compiler_COUNT][BUILD_FLAGS_MAX] = {
@@ -2352,6 +2797,10 @@ static String build_compiler_link_flags[Build_Compiler_COUNT][BASE_OS_COUNT][BUI
         string_constant("-fixed"),
         string_constant("libucrtd.lib"),
     } },
+    [Build_Compiler_CLANG] = { [BASE_OS_LINUX] = {
+        string_constant("-lm"),
+        string_constant("-lpthread"),
+    } },
     // [Build_Compiler_CLANG] = {
     //     [BASE_OS_MACOS] = {
     //         string_constant("-framework"), string_constant("CoreFoundation"),
@@ -2434,21 +2883,31 @@ static String build_compiler_out[Build_Compiler_COUNT] = {
     [Build_Compiler_EMCC] = string_constant("-o"),
 };
 
+// NOTE(felix): the tables above are statically sized, so each list of flags ends at its first empty string
+static Slice_String build_flags_slice(String *flags) {
+    Slice_String slice = { .data = flags };
+    while (slice.count < BUILD_FLAGS_MAX && flags[slice.count].count != 0) slice.count += 1;
+    return slice;
+}
+
 static Build_Compiler build_default_compiler[BASE_OS_COUNT] = {
     [BASE_OS_WINDOWS] = Build_Compiler_MSVC,
     [BASE_OS_MACOS] = Build_Compiler_CLANG,
+    [BASE_OS_LINUX] = Build_Compiler_CLANG,
     [BASE_OS_EMSCRIPTEN] = Build_Compiler_EMCC,
 };
 
 static String build_object_extension[BASE_OS_COUNT] = {
     [BASE_OS_WINDOWS] = string_constant("obj"),
     [BASE_OS_MACOS] = string_constant("o"),
+    [BASE_OS_LINUX] = string_constant("o"),
     [BASE_OS_EMSCRIPTEN] = string_constant("o"),
 };
 
 static String build_binary_extension[BASE_OS_COUNT] = {
     [BASE_OS_WINDOWS] = string_constant("exe"),
     [BASE_OS_MACOS] = string_constant("bin"),
+    [BASE_OS_LINUX] = string_constant("bin"),
     [BASE_OS_EMSCRIPTEN] = string_constant("html"),
 };
 
@@ -2471,7 +2930,62 @@ static char *build_emscripten_html = STRINGIFY(
     </html>
 );
 
-static u32 build_default_everything(Arena arena, String program_name, u8 target_os) {
+// NOTE(felix): builds an instrumented program, trains it, and merges what the training recorded into build/<program>.profdata
+static bool build_profile(Arena arena, Array_String compile, Build_Compiler compiler, String program_name, String binary_extension, String build_directory, Build_Training_Function *training) {
+    Os_Process_Flags flags = Os_Process_Flag_PRINT_COMMAND_BEFORE_RUNNING | Os_Process_Flag_PRINT_EXIT_CODE;
+
+    const char *profile_directory = (const char *)string_print(&arena, "%S/pgo\0", build_directory).data;
+    if (!os_file_info(profile_directory).exists && !os_make_directory(profile_directory, 0755)) return false;
+
+    // NOTE(felix): profiles from an older build would be out of date
+    Slice_String old_profiles = os_list_directory(&arena, profile_directory);
+    for_slice (String *, name, old_profiles) {
+        if (string_ends_with(*name, string(".profraw"))) os_remove_file((const char *)string_print(&arena, "%s/%S\0", profile_directory, *name).data);
+    }
+
+    String instrumented_name = string_print(&arena, "%S-instrumented.%S", program_name, binary_extension);
+    push(&compile, (string("-fprofile-instr-generate=pgo/%p.profraw"))); // NOTE(felix): %p makes one profile per process
+    push(&compile, string_print(&arena, "%S%S", build_compiler_out[compiler], instrumented_name));
+    if (os_process_run(arena, compile.slice, build_directory, flags) != 0) return false;
+
+    Array_String program_command = { .arena = &arena };
+    if (BASE_OS == BASE_OS_WINDOWS) {
+        push(&program_command, (string("cmd.exe")));
+        push(&program_command, (string("/c")));
+        push(&program_command, instrumented_name);
+    } else push(&program_command, string_print(&arena, "./%S", instrumented_name));
+
+    if (training(arena, program_command.slice, build_directory) != 0) {
+        log_error("training the instrumented build failed");
+        return false;
+    }
+
+    Array_String merge = { .arena = &arena };
+    if (BASE_OS == BASE_OS_WINDOWS) {
+        push(&merge, (string("cmd.exe")));
+        push(&merge, (string("/c")));
+    } else if (BASE_OS == BASE_OS_MACOS) push(&merge, (string("xcrun")));
+    push(&merge, (string("llvm-profdata")));
+    push(&merge, (string("merge")));
+    push(&merge, string_print(&arena, "-output=%S.profdata", program_name));
+
+    u64 profile_count = 0;
+    Slice_String profiles = os_list_directory(&arena, profile_directory);
+    for_slice (String *, name, profiles) {
+        if (!string_ends_with(*name, string(".profraw"))) continue;
+        push(&merge, string_print(&arena, "pgo/%S", *name));
+        profile_count += 1;
+    }
+
+    if (profile_count == 0) {
+        log_error("training the instrumented build recorded no profiles");
+        return false;
+    }
+
+    return os_process_run(arena, merge.slice, build_directory, flags) == 0;
+}
+
+static u32 build_default_everything(Arena arena, String program_name, u8 target_os, Build_Training_Function *training) {
     Scratch scratch = scratch_begin(&arena);
     Slice_String arguments = os_get_arguments(&arena);
     const char *c_file_path = "../src/main.c";
@@ -2549,10 +3063,11 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
     String shdc_per_os[BASE_OS_COUNT] = {
         [BASE_OS_WINDOWS] = string_print(&arena, "%S\\shdc\\sokol-shdc.exe\0", dependency_directory),
         [BASE_OS_MACOS] = string_print(&arena, "%S/shdc/sokol-shdc-macos.bin\0", dependency_directory),
+        [BASE_OS_LINUX] = string_print(&arena, "%S/shdc/sokol-shdc-linux.bin\0", dependency_directory),
     };
 
     const char *shdc = (const char *)shdc_per_os[BASE_OS].data;
-    if (BASE_OS == BASE_OS_MACOS) {
+    if (BASE_OS == BASE_OS_MACOS || BASE_OS == BASE_OS_LINUX) {
         static Os_File_Info info;
         info = os_file_info(&shdc[1]);
         shdc = info.full_path;
@@ -2574,8 +3089,7 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
             push(&common[c], (string("/c")));
         }
 
-        // TOOD(felix): this slice needs to end at the first 0-length member, because the C array is statically sized
-        Slice_String common_initial = slice_from_c_array(build_compiler_initial_command[c]);
+        Slice_String common_initial = build_flags_slice(build_compiler_initial_command[c]);
 
         push_slice(&common[c], common_initial);
         push_slice(&common[c], include_paths);
@@ -2593,7 +3107,7 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
             push(&link[c], argument);
         }
 
-        Slice_String link_initial = slice_from_c_array(build_compiler_link_flags[c][target_os]);
+        Slice_String link_initial = build_flags_slice(build_compiler_link_flags[c][target_os]);
         push_slice(&link[c], link_initial);
         if (is_raylib) {
             push_slice(&link[c], platform_objects);
@@ -2607,7 +3121,7 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
             Array_String *f = &flags[mode][c];
             f->arena = &arena;
 
-            Slice_String initial = slice_from_c_array(build_compiler_mode_flags[mode][c]);
+            Slice_String initial = build_flags_slice(build_compiler_mode_flags[mode][c]);
             push_slice(f, initial);
 
             if (mode == Build_Mode_DEBUG) {
@@ -2621,10 +3135,30 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
         }
     }
 
+    // NOTE(felix): `pgo` is a release build optimised with a profile of the program's training run, and implies `lto`. `march=<cpu>` targets a CPU, e.g. `march=native`
     Build_Mode mode = Build_Mode_DEBUG;
+    bool profile_guided = false, link_time_optimised = false;
+    String march = {0};
     for_slice (String *, argument, arguments) {
         if (string_equals(*argument, string("clang"))) compiler = Build_Compiler_CLANG;
         if (string_equals(*argument, string("release"))) mode = Build_Mode_RELEASE;
+        if (string_equals(*argument, string("lto"))) link_time_optimised = true;
+        if (string_equals(*argument, string("pgo"))) {
+            mode = Build_Mode_RELEASE;
+            profile_guided = true;
+            link_time_optimised = true;
+        }
+        if (string_starts_with(*argument, string("march="))) march = string_range(*argument, string("march=").count, argument->count);
+    }
+
+    bool clang_only = profile_guided || link_time_optimised || march.count != 0;
+    if (clang_only && compiler != Build_Compiler_CLANG) {
+        log_error("pgo, lto, and march= need clang; add `clang` to the arguments");
+        return 1;
+    }
+    if (profile_guided && training == 0) {
+        log_error("pgo needs a training run, but %S doesn't have one", program_name);
+        return 1;
     }
 
     Array_String compile = { .arena = &arena };
@@ -2641,7 +3175,8 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
     }
 
     push_slice(&compile, link[compiler]);
-    push(&compile, string_print(&arena, "%S%S.%S", build_compiler_out[compiler], program_name, binary_extension));
+    if (link_time_optimised) push(&compile, (string("-flto")));
+    if (march.count != 0) push(&compile, string_print(&arena, "-march=%S", march));
 
     String build_directory = string("build");
     bool build_directory_ok = os_file_info(cstring_from_string(&arena, build_directory)).exists;
@@ -2689,12 +3224,14 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
         String target_shader_language[BASE_OS_COUNT] = {
             [BASE_OS_WINDOWS] = string("hlsl5"),
             [BASE_OS_MACOS] = string("metal_macos"),
+            [BASE_OS_LINUX] = string("glsl430"),
             // [BASE_OS_EMSCRIPTEN] = string("wgsl"),
             [BASE_OS_EMSCRIPTEN] = string("glsl300es"),
         };
         String shdc_error_format[BASE_OS_COUNT] = {
             [BASE_OS_WINDOWS] = string("msvc"),
             [BASE_OS_MACOS] = string("gcc"),
+            [BASE_OS_LINUX] = string("gcc"),
         };
 
         if (BASE_OS == BASE_OS_WINDOWS) {
@@ -2719,8 +3256,18 @@ static u32 build_default_everything(Arena arena, String program_name, u8 target_
         shaders_ok = exit_code == 0;
     }
 
+    bool profile_ok = !profile_guided;
+    if (shaders_ok && profile_guided) {
+        Array_String instrumented_compile = { .arena = &arena };
+        push_slice(&instrumented_compile, compile);
+        profile_ok = build_profile(arena, instrumented_compile, compiler, program_name, binary_extension, build_directory, training);
+        push(&compile, string_print(&arena, "-fprofile-instr-use=%S.profdata", program_name));
+    }
+
+    push(&compile, string_print(&arena, "%S%S.%S", build_compiler_out[compiler], program_name, binary_extension));
+
     u32 exit_code = 1;
-    if (shaders_ok) {
+    if (shaders_ok && profile_ok) {
         exit_code = os_process_run(arena, compile.slice, build_directory, Os_Process_Flag_PRINT_COMMAND_BEFORE_RUNNING | Os_Process_Flag_PRINT_EXIT_CODE);
     }
 
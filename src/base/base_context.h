@@ -30,6 +30,19 @@
     #define COMPILER_STANDARD 1
 #endif // COMPILER_...
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+    #define ARCH_X64 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define ARCH_ARM64 1
+#endif // ARCH_...
+
+#ifndef ARCH_X64
+    #define ARCH_X64 0
+#endif
+#ifndef ARCH_ARM64
+    #define ARCH_ARM64 0
+#endif
+
 #ifndef COMPILER_CLANG
     #define COMPILER_CLANG 0
 #endif
@@ -9,10 +9,152 @@
 #define BASE_IMPLEMENTATION
 #include "base/base.h"
 
+// NOTE(felix): path coordinates are read as fixed point, with SVG_FIXED_ONE to a user unit, and go to twips through `fixed_min` and `twips_per_fixed`
 static struct {
     V2 min, size, scale;
+    i64 fixed_min_x, fixed_min_y;
+    f64 twips_per_fixed_x, twips_per_fixed_y;
 } g_viewbox;
 
+#define SVG_FIXED_ONE 65536
+
+// NOTE(felix): the widest instruction set that kernels with variants may use. Set once at startup
+static Cpu_Isa g_isa;
+
+// NOTE(felix): spans are written as Chrome trace-event JSON, which Perfetto and chrome://tracing both load.
+// Each worker slot owns a ring buffer that only its thread writes to, so recording a span is a couple of stores and no locks.
+// Slot 0 is the main thread, and slot 1 + i is helper i of jobs_run(), so the threads started for each phase of each frame reuse the rings of those before them.
+// When a ring wraps, the oldest spans of that slot are overwritten
+#define TRACE_RING_CAPACITY 4096
+#define TRACE_MAX_THREADS 64
+
+structdef(Trace_Span) {
+    const char *name;
+    i64 argument;
+    u64 begin_microseconds;
+    u64 duration_microseconds;
+};
+
+structdef(Trace_Ring) {
+    u32 thread_index;
+    u64 head; // total number of spans ever written; published with release semantics
+    Trace_Span spans[TRACE_RING_CAPACITY];
+};
+
+static struct {
+    bool enabled;
+    u64 origin_microseconds;
+    u64 dropped_span_count; // NOTE(felix): from threads in slots past TRACE_MAX_THREADS, which have no ring
+    Trace_Ring *rings[TRACE_MAX_THREADS];
+} g_trace;
+
+static thread_local Trace_Ring *trace_ring_for_this_thread;
+
+// NOTE(felix): only one thread may be in a slot at a time
+static void trace_attach_this_thread(u32 slot) {
+    trace_ring_for_this_thread = 0;
+    if (!g_trace.enabled || slot >= TRACE_MAX_THREADS) return;
+
+    Trace_Ring *ring = g_trace.rings[slot];
+    if (ring == 0) {
+        ring = os_heap_allocate(sizeof *ring);
+        zero(ring);
+        ring->thread_index = slot;
+        g_trace.rings[slot] = ring;
+    }
+    trace_ring_for_this_thread = ring;
+}
+
+// NOTE(felix): call from the main thread, so that it gets the first ring
+static void trace_init(void) {
+    g_trace.enabled = true;
+    g_trace.origin_microseconds = os_time_microseconds();
+    trace_attach_this_thread(0);
+}
+
+static u64 trace_begin(void) {
+    if (!g_trace.enabled) return 0;
+    return os_time_microseconds();
+}
+
+static void trace_end(const char *name, i64 argument, u64 begin_microseconds) {
+    if (!g_trace.enabled) return;
+    u64 end_microseconds = os_time_microseconds();
+
+    Trace_Ring *ring = trace_ring_for_this_thread;
+    if (ring == 0) {
+        atomic_add_u64(&g_trace.dropped_span_count, 1);
+        return;
+    }
+
+    u64 head = ring->head;
+    ring->spans[head & (TRACE_RING_CAPACITY - 1)] = (Trace_Span){
+        .name = name,
+        .argument = argument,
+        .begin_microseconds = begin_microseconds,
+        .duration_microseconds = end_microseconds - begin_microseconds,
+    };
+    atomic_store_release_u64(&ring->head, head + 1);
+}
+
+#define trace_scope_begin_(line) trace_begin_##line##__
+#define trace_scope_done_(line) trace_done_##line##__
+#define trace_scope_begin(line) trace_scope_begin_(line)
+#define trace_scope_done(line) trace_scope_done_(line)
+// NOTE(felix): like ui_defer_loop. Don't `break` or `return` out of the body, or the span is lost
+#define trace_scope(name, argument) \
+    for ( \
+        u64 trace_scope_begin(__LINE__) = trace_begin(), trace_scope_done(__LINE__) = 0; \
+        !trace_scope_done(__LINE__); \
+        trace_scope_done(__LINE__) = 1, trace_end((name), (argument), trace_scope_begin(__LINE__)) \
+    )
+
+// NOTE(felix): must only be called once every thread that recorded spans has been joined
+static bool trace_write(Arena *arena, const char *path) {
+    Scratch scratch = scratch_begin(arena);
+    String_Builder json = { .arena = scratch.arena };
+    string_builder_print(&json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    if (g_trace.dropped_span_count != 0) {
+        log_info("trace: dropped %llu spans from threads past the first %d", g_trace.dropped_span_count, TRACE_MAX_THREADS);
+    }
+
+    bool first = true;
+    for (u32 r = 0; r < TRACE_MAX_THREADS; r += 1) {
+        Trace_Ring *ring = g_trace.rings[r];
+        if (ring == 0) continue;
+        u32 tid = ring->thread_index + 1;
+
+        if (!first) string_builder_print(&json, ",\n");
+        first = false;
+        if (ring->thread_index == 0) {
+            string_builder_print(&json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"main\"}}", tid);
+        } else {
+            string_builder_print(&json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}", tid, ring->thread_index);
+        }
+
+        u64 head = atomic_load_acquire_u64(&ring->head);
+        u64 first_span = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+        if (first_span != 0) log_info("trace: thread %u overwrote its %llu oldest spans", tid, first_span);
+
+        for (u64 i = first_span; i < head; i += 1) {
+            Trace_Span *span = &ring->spans[i & (TRACE_RING_CAPACITY - 1)];
+            u64 ts = span->begin_microseconds - g_trace.origin_microseconds;
+            string_builder_print(&json,
+                ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu",
+                span->name, tid, ts, span->duration_microseconds
+            );
+            if (span->argument >= 0) string_builder_print(&json, ",\"args\":{\"index\":%lld}", span->argument);
+            string_builder_print(&json, "}");
+        }
+    }
+
+    string_builder_print(&json, "\n]}\n");
+    bool ok = os_write_entire_file(path, json.string);
+    scratch_end(scratch);
+    return ok;
+}
+
 static String string_from_xml(xml_Value value) {
     String result = {
         .data = (u8 *)value.start,
@@ -28,31 +170,62 @@ static bool xml_read_with_strings(xml_Reader *r, xml_Value *key, xml_Value *valu
     return result;
 }
 
+// NOTE(felix): SWF coordinates are at most 31-bit signed, and this leaves the difference of any two of them an i32
+#define SWF_TWIPS_MAX ((1 << 30) - 1)
+
+// NOTE(felix): the one rounding every coordinate goes through on its way to twips, to the nearest with halves up
+static i32 twips_round(f64 twips) {
+    f64 rounded = floor(twips + 0.5);
+    rounded = CLAMP(rounded, -(f64)SWF_TWIPS_MAX, (f64)SWF_TWIPS_MAX);
+    return (i32)rounded;
+}
+
 static i32 twips_from_pixels(f32 pixels) {
-    i32 result = (i32)(pixels * 20.f + 0.5f);
+    i32 result = twips_round((f64)pixels * 20);
     return result;
 }
 
-static i32 twips_from_svg_x(f32 x) { return twips_from_pixels((x - g_viewbox.min.x) * g_viewbox.scale.x); }
-static i32 twips_from_svg_y(f32 y) { return twips_from_pixels((y - g_viewbox.min.y) * g_viewbox.scale.y); }
-static i32 twips_from_svg_dx(f32 dx) { return twips_from_pixels(dx * g_viewbox.scale.x); }
-static i32 twips_from_svg_dy(f32 dy) { return twips_from_pixels(dy * g_viewbox.scale.y); }
+static i64 fixed_from_svg(f64 value) { return (i64)floor(value * SVG_FIXED_ONE + 0.5); }
+
+static f64 twips_unrounded_from_fixed_x(i64 x) { return (f64)(x - g_viewbox.fixed_min_x) * g_viewbox.twips_per_fixed_x; }
+static f64 twips_unrounded_from_fixed_y(i64 y) { return (f64)(y - g_viewbox.fixed_min_y) * g_viewbox.twips_per_fixed_y; }
+
+static i32 twips_from_fixed_x(i64 x) { return twips_round(twips_unrounded_from_fixed_x(x)); }
+static i32 twips_from_fixed_y(i64 y) { return twips_round(twips_unrounded_from_fixed_y(y)); }
+
+static i32 twips_from_svg_x(f32 x) { return twips_from_fixed_x(fixed_from_svg(x)); }
+static i32 twips_from_svg_y(f32 y) { return twips_from_fixed_y(fixed_from_svg(y)); }
+static i32 twips_from_svg_dx(f32 dx) { return twips_round((f64)fixed_from_svg(dx) * g_viewbox.twips_per_fixed_x); }
+static i32 twips_from_svg_dy(f32 dy) { return twips_round((f64)fixed_from_svg(dy) * g_viewbox.twips_per_fixed_y); }
+
+static u32 swf_sbits_width(i32 v) {
+    for (u32 n = 1; n <= 32; n += 1) {
+        i64 minv = -((i64)1 << (n - 1));
+        i64 maxv =  ((i64)1 << (n - 1)) - 1;
+        if ((i64)v >= minv && (i64)v <= maxv) return n;
+    }
+    return 32;
+}
 
-structdef(SWF_Rect) { u8 bytes[9]; };
-static SWF_Rect swf_rect(i16 x_min, i16 x_max, i16 y_min, i16 y_max) {
+// NOTE(felix): 5 bits of NBits, then four fields of as few bits as the widest value needs, up to 31
+structdef(SWF_Rect) { u8 bytes[17]; u8 count; };
+static SWF_Rect swf_rect(i32 x_min, i32 x_max, i32 y_min, i32 y_max) {
     SWF_Rect rect = {0};
     u8 *r = rect.bytes;
 
-    u8 bits_per_field = 15;
-    assert(bits_per_field <= 31);
-    r[0] |= bits_per_field << 3;
+    i32 values[4] = { x_min, x_max, y_min, y_max };
 
-    i16 values[4] = { x_min, x_max, y_min, y_max };
+    u32 bits_per_field = 1;
+    for (u64 value_index = 0; value_index < 4; value_index += 1) {
+        values[value_index] = CLAMP(values[value_index], -SWF_TWIPS_MAX, SWF_TWIPS_MAX);
+        bits_per_field = MAX(bits_per_field, swf_sbits_width(values[value_index]));
+    }
+    r[0] |= (u8)(bits_per_field << 3);
 
     u64 r_bit = 5;
     for (u64 value_index = 0; value_index < 4; value_index += 1) {
-        u16 unsigned_value = bit_cast(u16) values[value_index];
-        for (i32 bit = bits_per_field - 1; bit >= 0; bit -= 1, r_bit += 1) {
+        u32 unsigned_value = bit_cast(u32) values[value_index];
+        for (i32 bit = (i32)bits_per_field - 1; bit >= 0; bit -= 1, r_bit += 1) {
             u64 r_byte = r_bit >> 3;
             u64 r_bit_in_byte = 7 - (r_bit & 7);
             u8 b = (u8)((unsigned_value >> bit) & 1);
@@ -60,6 +233,7 @@ static SWF_Rect swf_rect(i16 x_min, i16 x_max, i16 y_min, i16 y_max) {
         }
     }
 
+    rect.count = (u8)((r_bit + 7) >> 3);
     return rect;
 }
 
@@ -71,10 +245,58 @@ typedef enum SVG_Part_Kind {
     SVG_Part_Kind_COUNT,
 } SVG_Part_Kind;
 
+typedef enum SVG_Fill_Rule {
+    SVG_Fill_Rule_NONZERO,
+    SVG_Fill_Rule_EVENODD,
+} SVG_Fill_Rule;
+
+// NOTE(felix): the presentation properties we understand, whether they came from attributes or from the style attribute
+structdef(SVG_Style) {
+    u32 fill_rgba, stroke_rgba; // 0 for none
+    f32 stroke_width;
+    f32 opacity, fill_opacity, stroke_opacity;
+    SVG_Fill_Rule fill_rule;
+    bool display_none, visibility_hidden;
+    u16 padding_; // NOTE(felix): no implicit padding, so that styles can be hashed and compared as bytes
+};
+
+// NOTE(felix): SVG's initial values
+static const SVG_Style svg_style_initial = {
+    .fill_rgba = 0x000000ff,
+    .stroke_width = 1,
+    .opacity = 1, .fill_opacity = 1, .stroke_opacity = 1,
+};
+
+// NOTE(felix): why a part is left out. A culled part is neither encoded nor placed
+typedef enum SVG_Cull {
+    SVG_Cull_NONE,
+    SVG_Cull_INVISIBLE, // NOTE(felix): hidden, or with neither a visible fill nor a visible stroke
+    SVG_Cull_EMPTY, // NOTE(felix): a rect or ellipse without area, which SVG doesn't render at all, or a path with no edges left once snapped to the grid
+    SVG_Cull_OFF_STAGE, // NOTE(felix): entirely outside the movie's frame
+    SVG_Cull_SMALL, // NOTE(felix): every subpath smaller than --min-feature-size
+    SVG_Cull_OCCLUDED, // NOTE(felix): entirely under opaque rects painted after it
+
+    SVG_Cull_COUNT,
+} SVG_Cull;
+
+static const char *svg_cull_names[SVG_Cull_COUNT] = {
+    [SVG_Cull_INVISIBLE] = "invisible",
+    [SVG_Cull_EMPTY] = "empty",
+    [SVG_Cull_OFF_STAGE] = "off stage",
+    [SVG_Cull_SMALL] = "small",
+    [SVG_Cull_OCCLUDED] = "occluded",
+};
+
 structdef(SVG_Part) {
     SVG_Part_Kind kind;
-    u32 fill_rgba;
-    f32 stroke_width;
+    SVG_Style style;
+    u32 style_id; // NOTE(felix): index into the interned styles, assigned once the whole document is parsed
+    bool duplicate; // NOTE(felix): not encoded, because it's in a group identical to an earlier one
+    bool reused; // NOTE(felix): some <use> places it again, possibly somewhere else, so its own bounds don't say where it's drawn
+    bool transformed; // NOTE(felix): it, or a group it's inside, has a transform, so its own bounds don't say where it's drawn either
+    SVG_Cull cull;
+    String id;
+    M3 transform;
     union {
         struct {
             String d;
@@ -89,56 +311,298 @@ structdef(SVG_Part) {
     };
 };
 
+typedef enum SVG_Event_Kind {
+    SVG_Event_Kind_GROUP_BEGIN,
+    SVG_Event_Kind_GROUP_END,
+    SVG_Event_Kind_USE,
+} SVG_Event_Kind;
+
+// NOTE(felix): document structure other than parts, at its position among the parts
+structdef(SVG_Event) {
+    u64 part_index;
+    SVG_Event_Kind kind;
+    bool hidden; // NOTE(felix): for <defs> and <symbol>, whose contents are only drawn through <use>
+    String id;
+    String href; // NOTE(felix): without the leading '#'
+    M3 transform; // NOTE(felix): of a group or <use>. A part's is in the part
+};
+
 typedef enum SWF_Tag_Type {
-    SWF_Tag_Type_END          =  0,
-    SWF_Tag_Type_SHOWFRAME    =  1,
-    SWF_Tag_Type_PLACEOBJECT2 = 26,
-    SWF_Tag_Type_DEFINESHAPE3 = 32,
+    SWF_Tag_Type_END           =  0,
+    SWF_Tag_Type_SHOWFRAME     =  1,
+    SWF_Tag_Type_DEFINESHAPE   =  2,
+    SWF_Tag_Type_DEFINESHAPE2  = 22,
+    SWF_Tag_Type_PLACEOBJECT2  = 26,
+    SWF_Tag_Type_REMOVEOBJECT2 = 28,
+    SWF_Tag_Type_DEFINESHAPE3  = 32,
+    SWF_Tag_Type_DEFINESPRITE  = 39,
 } SWF_Tag_Type;
 
-static void svg_part_parse_style(SVG_Part *part, String style) {
-    {
-        assert(string_starts_with(style, string("fill:")));
+// NOTE(felix): the first SWF version with the tag
+static u8 swf_tag_version(SWF_Tag_Type type) {
+    switch (type) {
+        case SWF_Tag_Type_END: case SWF_Tag_Type_SHOWFRAME: case SWF_Tag_Type_DEFINESHAPE: return 1;
+        case SWF_Tag_Type_DEFINESHAPE2: return 2;
+        case SWF_Tag_Type_PLACEOBJECT2: case SWF_Tag_Type_REMOVEOBJECT2: case SWF_Tag_Type_DEFINESHAPE3: case SWF_Tag_Type_DEFINESPRITE: return 3;
+        default: unreachable;
+    }
+    return 0;
+}
+
+// NOTE(felix): every tag, attribute, and style property name we look at. Names are matched by a table lookup on their length and first and last bytes, then one comparison,
+// so the many names we don't care about (like Inkscape's namespaced ones) are usually turned away after the lookup or the first byte
+#define _for_svg_name(action)\
+    action(SVG, "svg", 's', 'g') action(PATH, "path", 'p', 'h') action(ELLIPSE, "ellipse", 'e', 'e') action(RECT, "rect", 'r', 't') action(G, "g", 'g', 'g')\
+    action(DEFS, "defs", 'd', 's') action(SYMBOL, "symbol", 's', 'l') action(USE, "use", 'u', 'e')\
+    action(ID, "id", 'i', 'd') action(HREF, "href", 'h', 'f') action(XLINK_HREF, "xlink:href", 'x', 'f') action(TRANSFORM, "transform", 't', 'm')\
+    action(WIDTH, "width", 'w', 'h') action(HEIGHT, "height", 'h', 't') action(VIEWBOX, "viewBox", 'v', 'x') action(STYLE, "style", 's', 'e')\
+    action(D, "d", 'd', 'd') action(CX, "cx", 'c', 'x') action(CY, "cy", 'c', 'y') action(RX, "rx", 'r', 'x') action(RY, "ry", 'r', 'y')\
+    action(X, "x", 'x', 'x') action(Y, "y", 'y', 'y')\
+    action(FILL, "fill", 'f', 'l') action(FILL_OPACITY, "fill-opacity", 'f', 'y') action(FILL_RULE, "fill-rule", 'f', 'e')\
+    action(STROKE, "stroke", 's', 'e') action(STROKE_WIDTH, "stroke-width", 's', 'h') action(STROKE_OPACITY, "stroke-opacity", 's', 'y')\
+    action(OPACITY, "opacity", 'o', 'y') action(DISPLAY, "display", 'd', 'y') action(VISIBILITY, "visibility", 'v', 'y')
+
+typedef enum SVG_Name {
+    SVG_Name_OTHER,
+    #define _make_svg_name_enum(name, text, first, last) SVG_Name_##name,
+    _for_svg_name(_make_svg_name_enum)
+    SVG_Name_COUNT,
+} SVG_Name;
+
+static String svg_name_strings[SVG_Name_COUNT] = {
+    #define _make_svg_name_string(name, text, first, last) [SVG_Name_##name] = string_constant(text),
+    _for_svg_name(_make_svg_name_string)
+};
+
+#define svg_name_slot(length, first, last) (((u64)(length) << 5 ^ (u64)(first) << 4 ^ (u64)(last)) & 511)
 
-        u64 fill_start = string("fill:").count;
+// NOTE(felix): no two names may share a slot, or one would be silently taken for the other. svg_name_check() catches it at startup
+static const u8 svg_name_from_slot[512] = {
+    #define _make_svg_name_slot(name, text, first, last) [svg_name_slot(sizeof(text) - 1, first, last)] = SVG_Name_##name,
+    _for_svg_name(_make_svg_name_slot)
+};
 
-        u64 fill_end = fill_start;
-        while (fill_end < style.count && style.data[fill_end] != ';') fill_end += 1;
-        assert(fill_end < style.count);
+static SVG_Name svg_name_classify(String name) {
+    if (name.count == 0) return SVG_Name_OTHER;
+    SVG_Name candidate = svg_name_from_slot[svg_name_slot(name.count, name.data[0], name.data[name.count - 1])];
+    if (candidate == SVG_Name_OTHER || !string_equals(name, svg_name_strings[candidate])) return SVG_Name_OTHER;
+    return candidate;
+}
 
-        String fill = slice_range(style, fill_start, fill_end);
+// NOTE(felix): a shared slot is also a duplicate case label, which doesn't compile. The first and last bytes are checked against the text at runtime, since C can't
+static void svg_name_check(void) {
+    switch (0) {
+        #define _make_svg_name_case(name, text, first, last) case svg_name_slot(sizeof(text) - 1, first, last): break;
+        _for_svg_name(_make_svg_name_case)
+        default: break;
+    }
 
-        if (fill.data[0] == '#') {
-            String rgb_string = string_range(fill, 1, fill.count);
-            u32 rgb = (u32)int_from_string_base(rgb_string, 16);
-            part->fill_rgba = (rgb << 8) | 0xff;
-        } else {
-            assert(string_equals(fill, string("none")));
-            part->fill_rgba = 0;
-        }
-    }
-    {
-        String needle = string("stroke-width:");
-        u64 stroke_width_start = 0;
-        for (u64 i = 0; i < style.count - needle.count; i += 1) {
-            String shift = string_range(style, i, style.count);
-            if (string_starts_with(shift, needle)) {
-                stroke_width_start = i + needle.count;
-                break;
-            }
+    for (SVG_Name name = SVG_Name_OTHER + 1; name < SVG_Name_COUNT; name += 1) {
+        String text = svg_name_strings[name];
+        if (svg_name_classify(text) != name) panic("SVG name '%S' shares a slot with another name, or its first or last byte is wrong in _for_svg_name", text);
+    }
+}
+
+// NOTE(felix): the number at the start of `s`, so that units like "px" are ignored. A trailing '%' divides by 100
+static f32 svg_number_from_string(String s) {
+    s = string_trim_whitespace(s);
+    u64 end = 0;
+    while (end < s.count && (ascii_is_decimal(s.data[end]) || s.data[end] == '.' || s.data[end] == '-' || s.data[end] == '+')) end += 1;
+
+    String number = string_range(s, s.data != 0 && s.count > 0 && s.data[0] == '+', end);
+    f32 result = (f32)f64_from_string(number);
+    if (end < s.count && s.data[end] == '%') result /= 100;
+    return result;
+}
+
+#define _for_svg_named_color(action)\
+    action("black", 0x000000) action("white", 0xffffff) action("red", 0xff0000) action("lime", 0x00ff00)\
+    action("blue", 0x0000ff) action("yellow", 0xffff00) action("cyan", 0x00ffff) action("magenta", 0xff00ff)\
+    action("gray", 0x808080) action("grey", 0x808080) action("green", 0x008000) action("orange", 0xffa500)
+
+// NOTE(felix): false for colours we don't understand, which leaves the property as it was
+static bool svg_rgba_from_string(String s, u32 *rgba) {
+    s = string_trim_whitespace(s);
+    if (s.count == 0) return false;
+
+    if (string_equals(s, string("none")) || string_equals(s, string("transparent"))) {
+        *rgba = 0;
+        return true;
+    }
+
+    if (s.data[0] == '#') {
+        String hex = string_range(s, 1, s.count);
+        if (hex.count != 3 && hex.count != 6) return false;
+        for_slice (u8 *, c, hex) if (!ascii_is_hexadecimal(*c)) return false;
+
+        u32 rgb = (u32)int_from_string_base(hex, 16);
+        if (hex.count == 3) rgb = ((rgb & 0xf00) * 0x1100) | ((rgb & 0xf0) * 0x110) | ((rgb & 0xf) * 0x11);
+        *rgba = (rgb << 8) | 0xff;
+        return true;
+    }
+
+    if (string_starts_with(s, string("rgb(")) && s.data[s.count - 1] == ')') {
+        String arguments = string_range(s, string("rgb(").count, s.count - 1);
+        u32 rgb = 0;
+        u64 channel_count = 0;
+        for (u64 i = 0; i < arguments.count && channel_count < 3;) {
+            u64 end = i;
+            while (end < arguments.count && arguments.data[end] != ',' && arguments.data[end] != ' ') end += 1;
+            String channel_string = string_trim_whitespace(string_range(arguments, i, end));
+            i = end + 1;
+            if (channel_string.count == 0) continue;
+
+            f32 channel = svg_number_from_string(channel_string);
+            if (channel_string.data[channel_string.count - 1] == '%') channel *= 255;
+            rgb = (rgb << 8) | (u32)CLAMP(channel + 0.5f, 0, 255);
+            channel_count += 1;
+        }
+        if (channel_count != 3) return false;
+        *rgba = (rgb << 8) | 0xff;
+        return true;
+    }
+
+    #define _check_svg_named_color(name, rgb) if (string_equals(s, string(name))) { *rgba = ((u32)(rgb) << 8) | 0xff; return true; }
+    _for_svg_named_color(_check_svg_named_color)
+
+    return false;
+}
+
+// NOTE(felix): false for names that aren't style properties
+static bool svg_style_apply(SVG_Style *style, SVG_Name name, String value) {
+    value = string_trim_whitespace(value);
+    switch (name) {
+        case SVG_Name_FILL: svg_rgba_from_string(value, &style->fill_rgba); break;
+        case SVG_Name_STROKE: svg_rgba_from_string(value, &style->stroke_rgba); break;
+        case SVG_Name_STROKE_WIDTH: style->stroke_width = svg_number_from_string(value); break;
+        case SVG_Name_OPACITY: style->opacity = CLAMP(svg_number_from_string(value), 0, 1); break;
+        case SVG_Name_FILL_OPACITY: style->fill_opacity = CLAMP(svg_number_from_string(value), 0, 1); break;
+        case SVG_Name_STROKE_OPACITY: style->stroke_opacity = CLAMP(svg_number_from_string(value), 0, 1); break;
+        case SVG_Name_FILL_RULE: {
+            if (string_equals(value, string("evenodd"))) style->fill_rule = SVG_Fill_Rule_EVENODD;
+            else if (string_equals(value, string("nonzero"))) style->fill_rule = SVG_Fill_Rule_NONZERO;
+        } break;
+        case SVG_Name_DISPLAY: style->display_none = string_equals(value, string("none")); break;
+        case SVG_Name_VISIBILITY: style->visibility_hidden = string_equals(value, string("hidden")) || string_equals(value, string("collapse")); break;
+        default: return false;
+    }
+    return true;
+}
+
+// NOTE(felix): one pass over `property: value;` declarations, in any order. Properties we don't know are skipped
+static void svg_style_parse(SVG_Style *style, String css) {
+    for (u64 i = 0; i < css.count;) {
+        u64 colon = i;
+        while (colon < css.count && css.data[colon] != ':' && css.data[colon] != ';') colon += 1;
+
+        u64 end = colon;
+        while (end < css.count && css.data[end] != ';') end += 1;
+
+        if (colon < end) {
+            String name = string_trim_whitespace(string_range(css, i, colon));
+            String value = string_range(css, colon + 1, end);
+            svg_style_apply(style, svg_name_classify(name), value);
+        }
+
+        i = end + 1;
+    }
+}
+
+static bool svg_is_separator(u8 c) { return ascii_is_whitespace(c) || c == ','; }
+
+// NOTE(felix): the transform functions in `transform`, composed left to right. Functions we don't know are skipped
+static M3 svg_transform_parse(String transform) {
+    M3 result = m3_fill_diagonal(1);
+    for (u64 i = 0; i < transform.count;) {
+        while (i < transform.count && svg_is_separator(transform.data[i])) i += 1;
+
+        u64 open = i;
+        while (open < transform.count && transform.data[open] != '(') open += 1;
+        u64 close = open;
+        while (close < transform.count && transform.data[close] != ')') close += 1;
+        if (close == transform.count) break;
+
+        String name = string_trim_whitespace(string_range(transform, i, open));
+        String arguments = string_range(transform, open + 1, close);
+        i = close + 1;
+
+        f32 v[6] = {0};
+        u64 n = 0;
+        for (u64 j = 0; j < arguments.count && n < array_count(v);) {
+            while (j < arguments.count && svg_is_separator(arguments.data[j])) j += 1;
+            u64 end = j;
+            while (end < arguments.count && !svg_is_separator(arguments.data[end])) end += 1;
+            if (end > j) v[n++] = svg_number_from_string(string_range(arguments, j, end));
+            j = end;
         }
-        assert(stroke_width_start != 0);
 
-        u64 stroke_width_end = stroke_width_start;
-        while (stroke_width_end < style.count && style.data[stroke_width_end] != ';') stroke_width_end += 1;
-        assert(stroke_width_end < style.count);
+        M3 m = m3_fill_diagonal(1);
+        if (string_equals(name, string("matrix")) && n == 6) {
+            m.c[0][0] = v[0]; m.c[0][1] = v[1];
+            m.c[1][0] = v[2]; m.c[1][1] = v[3];
+            m.c[2][0] = v[4]; m.c[2][1] = v[5];
+        } else if (string_equals(name, string("translate")) && n >= 1) {
+            m.c[2][0] = v[0];
+            m.c[2][1] = v[1];
+        } else if (string_equals(name, string("scale")) && n >= 1) {
+            m.c[0][0] = v[0];
+            m.c[1][1] = n > 1 ? v[1] : v[0];
+        } else if (string_equals(name, string("rotate")) && n >= 1) {
+            V2 pivot = n >= 3 ? (V2){ .x = v[1], .y = v[2] } : (V2){0};
+            m = m3_from_rotation(radians_from_degrees(v[0]), pivot);
+        } else if (string_equals(name, string("skewX")) && n >= 1) {
+            m.c[1][0] = tanf(radians_from_degrees(v[0]));
+        } else if (string_equals(name, string("skewY")) && n >= 1) {
+            m.c[0][1] = tanf(radians_from_degrees(v[0]));
+        } else continue;
+
+        result = m3_mul_m3(result, m);
+    }
+    return result;
+}
+
+static bool svg_transform_is_identity(M3 transform) {
+    M3 identity = m3_fill_diagonal(1);
+    return string_equals(as_bytes(&transform), as_bytes(&identity));
+}
+
+structdef(SVG_Style_Cached) { String css; SVG_Style style; };
+
+#define SVG_STYLE_CACHE_CAPACITY 1024
+
+// NOTE(felix): exports repeat the same few style attributes across hundreds of elements, so each distinct one is only parsed once
+static SVG_Style svg_style_parse_cached(Map_SVG_Style_Cached *cache, String css) {
+    u64 hash = hash_djb2(css);
+    Map_Result found = map_get(cache, hash, 0);
+    if (found.pointer != 0) {
+        SVG_Style_Cached *cached = found.pointer;
+        if (string_equals(cached->css, css)) return cached->style;
+    }
+
+    SVG_Style_Cached parsed = { .css = css, .style = svg_style_initial };
+    svg_style_parse(&parsed.style, css);
 
-        String stroke_width_string = string_range(style, stroke_width_start, stroke_width_end);
+    bool full = cache->count + 1 >= cache->capacity * MAP_MAX_LOAD_FACTOR / 100;
+    if (found.pointer == 0 && !full) map_get(cache, hash, &parsed);
+    return parsed.style;
+}
 
-        part->stroke_width = (f32)f64_from_string(stroke_width_string);
+// NOTE(felix): returns the style's ID, with equal styles sharing one. Keys are the hash of the style's bytes, stepping past any collision
+static u32 svg_style_intern(Map_SVG_Style *styles, SVG_Style *style) {
+    String bytes = as_bytes(style);
+    for (u64 key = hash_djb2(bytes);; key += 1) {
+        Map_Result found = map_get(styles, key, 0);
+        if (found.pointer == 0) found = map_get(styles, key, style);
+        else if (!string_equals(as_bytes((SVG_Style *)found.pointer), bytes)) continue;
+        return (u32)found.index;
     }
 }
 
+static u32 svg_rgba_with_opacity(u32 rgba, f32 opacity) {
+    u32 alpha = (u32)((f32)(rgba & 0xff) * opacity + 0.5f);
+    return (rgba & 0xffffff00) | alpha;
+}
+
 static void swf_write_u16(String_Builder *swf, u16 value) {
     push(swf, (u8)value);
     push(swf, (u8)(value >> 8));
@@ -161,18 +625,22 @@ structdef(SWF_Line_Style) {
     u32 color;
 };
 
+// NOTE(felix): a shape without fill or line has an empty array for it, and no bits for its index in the shape records.
+// `tag_type` is the first DefineShape version that can hold the styles: DefineShape3 for any translucent colour, DefineShape otherwise.
+// DefineShape2 is never needed, since its only addition for us is more than 255 styles
 structdef(SWF_Shape_With_Style) {
     SWF_Fill_Style fill_style;
     SWF_Line_Style line_style;
+    bool has_fill, has_line;
+    SWF_Tag_Type tag_type;
 };
 
-static u32 swf_sbits_width(i32 v) {
-    for (u32 n = 1; n <= 32; n += 1) {
-        i64 minv = -((i64)1 << (n - 1));
-        i64 maxv =  ((i64)1 << (n - 1)) - 1;
-        if ((i64)v >= minv && (i64)v <= maxv) return n;
-    }
-    return 32;
+// NOTE(felix): RGB before DefineShape3, and RGBA from then on
+static void swf_push_color(String_Builder *swf, u32 rgba, SWF_Tag_Type tag_type) {
+    push(swf, (u8)(rgba >> 24));
+    push(swf, (u8)(rgba >> 16));
+    push(swf, (u8)(rgba >> 8));
+    if (tag_type == SWF_Tag_Type_DEFINESHAPE3) push(swf, (u8)(rgba >> 0));
 }
 
 typedef struct SWF_Bit_Writer {
@@ -212,6 +680,94 @@ static void swf_bw_byte_align(SWF_Bit_Writer *w) {
     }
 }
 
+// NOTE(felix): an edge record's NumBits field is 4 bits, so its deltas are at most 17-bit signed. Longer edges are written as several
+#define SWF_EDGE_DELTA_MAX ((1 << 16) - 1)
+
+static void swf_bw_push_line(SWF_Bit_Writer *bw, i32 dx, i32 dy) {
+    i64 longest = MAX(llabs(dx), llabs(dy));
+    i64 piece_count = MAX((longest + SWF_EDGE_DELTA_MAX - 1) / SWF_EDGE_DELTA_MAX, 1);
+
+    i32 done_x = 0, done_y = 0;
+    for (i64 piece = 1; piece <= piece_count; piece += 1) {
+        i32 to_x = (i32)((i64)dx * piece / piece_count);
+        i32 to_y = (i32)((i64)dy * piece / piece_count);
+        i32 piece_dx = to_x - done_x;
+        i32 piece_dy = to_y - done_y;
+        done_x = to_x;
+        done_y = to_y;
+
+        swf_bw_push_bit(bw, 1); /* TypeFlag: edge */
+        swf_bw_push_bit(bw, 1); /* StraightFlag: straight */
+
+        u32 n = MAX(swf_sbits_width(piece_dx), swf_sbits_width(piece_dy));
+        n = MAX(n, 2);
+        swf_bw_push_ubits(bw, n - 2, 4); /* NumBits */
+
+        bool general = piece_dx != 0 && piece_dy != 0;
+        swf_bw_push_bit(bw, general); /* GeneralLineFlag */
+        if (general) {
+            swf_bw_push_sbits(bw, piece_dx, n);
+            swf_bw_push_sbits(bw, piece_dy, n);
+        } else {
+            bool vertical = piece_dx == 0;
+            swf_bw_push_bit(bw, vertical); /* VertLineFlag */
+            swf_bw_push_sbits(bw, vertical ? piece_dy : piece_dx, n);
+        }
+    }
+}
+
+static void swf_bw_push_curve(SWF_Bit_Writer *bw, i32 from_x, i32 from_y, i32 control_x, i32 control_y, i32 x, i32 y) {
+    i32 control_dx = control_x - from_x;
+    i32 control_dy = control_y - from_y;
+    i32 anchor_dx = x - control_x;
+    i32 anchor_dy = y - control_y;
+
+    u32 n = swf_sbits_width(control_dx);
+    n = MAX(n, swf_sbits_width(control_dy));
+    n = MAX(n, swf_sbits_width(anchor_dx));
+    n = MAX(n, swf_sbits_width(anchor_dy));
+    n = MAX(n, 2);
+
+    if (n > 17) {
+        // NOTE(felix): split in two at t = 1/2, which keeps each half within a twip of the curve
+        i32 middle_x = (i32)(((i64)from_x + 2 * (i64)control_x + x) / 4);
+        i32 middle_y = (i32)(((i64)from_y + 2 * (i64)control_y + y) / 4);
+        swf_bw_push_curve(bw, from_x, from_y, (i32)(((i64)from_x + control_x) / 2), (i32)(((i64)from_y + control_y) / 2), middle_x, middle_y);
+        swf_bw_push_curve(bw, middle_x, middle_y, (i32)(((i64)control_x + x) / 2), (i32)(((i64)control_y + y) / 2), x, y);
+        return;
+    }
+
+    swf_bw_push_bit(bw, 1); /* TypeFlag: edge */
+    swf_bw_push_bit(bw, 0); /* StraightFlag: curved */
+    swf_bw_push_ubits(bw, n - 2, 4); /* NumBits */
+    swf_bw_push_sbits(bw, control_dx, n);
+    swf_bw_push_sbits(bw, control_dy, n);
+    swf_bw_push_sbits(bw, anchor_dx, n);
+    swf_bw_push_sbits(bw, anchor_dy, n);
+}
+
+// NOTE(felix): a StyleChangeRecord moving the pen. Styles persist across records, so only a shape's first one needs to select them
+static void swf_bw_push_move(SWF_Bit_Writer *bw, SWF_Shape_With_Style shapes, i32 x, i32 y, bool select_styles) {
+    bool line = select_styles && shapes.has_line;
+    bool fill = select_styles && shapes.has_fill;
+
+    swf_bw_push_bit(bw, 0); /* TypeFlag: non-edge */
+    swf_bw_push_bit(bw, 0); /* StateNewStyles */
+    swf_bw_push_bit(bw, line); /* StateLineStyle */
+    swf_bw_push_bit(bw, 0); /* StateFillStyle1 */
+    swf_bw_push_bit(bw, fill); /* StateFillStyle0 */
+    swf_bw_push_bit(bw, 1); /* StateMoveTo */
+
+    u32 move_bits = MAX(swf_sbits_width(x), swf_sbits_width(y));
+    assert(move_bits <= 31);
+    swf_bw_push_ubits(bw, move_bits, 5);
+    swf_bw_push_sbits(bw, x, move_bits);
+    swf_bw_push_sbits(bw, y, move_bits);
+
+    if (fill) swf_bw_push_ubits(bw, 1, 1); /* FillStyle0 index (NumFillBits=1) */
+    if (line) swf_bw_push_ubits(bw, 1, 1); /* LineStyle index (NumLineBits=1) */
+}
+
 static bool svg_path_is_cmd(u8 c) {
     return ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'));
 }
@@ -224,391 +780,851 @@ static void svg_path_skip(String d, u64 *i) {
     }
 }
 
-static f32 svg_path_read_f32(String d, u64 *i) {
+// NOTE(felix): one number by the SVG grammar, so that "1-2" and ".5.5" are two numbers each, as path data minifiers like to write them.
+// It's read straight into fixed point, correctly rounded, so that relative commands add up exactly. Digits past the 13th significant one are dropped
+static i64 svg_path_read_fixed(String d, u64 *i) {
     svg_path_skip(d, i);
     assert(*i < d.count);
-
-    u64 start = *i;
-    while (*i < d.count) {
-        u8 c = d.data[*i];
-        bool ok =
-            (c >= '0' && c <= '9') ||
-            c == '+' || c == '-' ||
-            c == '.' || c == 'e' || c == 'E';
-        if (!ok) break;
+    u64 begin = *i;
+
+    bool negative = d.data[*i] == '-';
+    if (d.data[*i] == '+' || d.data[*i] == '-') (*i) += 1;
+
+    // NOTE(felix): the number is mantissa * 10^exponent
+    u64 mantissa = 0;
+    i64 exponent = 0;
+    u64 digit_count = 0;
+    u64 max_mantissa = 1000000000000ull; // NOTE(felix): small enough that mantissa << 16 can't overflow
+    for (; *i < d.count && ascii_is_decimal(d.data[*i]); (*i) += 1, digit_count += 1) {
+        if (mantissa < max_mantissa) mantissa = mantissa * 10 + (u64)(d.data[*i] - '0');
+        else exponent += 1;
+    }
+    if (*i < d.count && d.data[*i] == '.') {
         (*i) += 1;
+        for (; *i < d.count && ascii_is_decimal(d.data[*i]); (*i) += 1, digit_count += 1) {
+            if (mantissa >= max_mantissa) continue;
+            mantissa = mantissa * 10 + (u64)(d.data[*i] - '0');
+            exponent -= 1;
+        }
+    }
+    assert(digit_count > 0);
+
+    if (*i + 1 < d.count && (d.data[*i] == 'e' || d.data[*i] == 'E')) {
+        u64 e = *i + 1;
+        bool negative_exponent = d.data[e] == '-';
+        if (d.data[e] == '+' || d.data[e] == '-') e += 1;
+        if (e < d.count && ascii_is_decimal(d.data[e])) {
+            i64 written = 0;
+            for (; e < d.count && ascii_is_decimal(d.data[e]); e += 1) written = MIN(written * 10 + (d.data[e] - '0'), 1000);
+            exponent += negative_exponent ? -written : written;
+            *i = e;
+        }
+    }
+
+    u64 fixed = mantissa * SVG_FIXED_ONE;
+    if (exponent >= 0) {
+        for (; exponent > 0 && fixed != 0; exponent -= 1) {
+            if (fixed > (u64)INT64_MAX / 10) {
+                log_error("number too large in path data: '%S'", string_range(d, begin, *i));
+                os_exit(1);
+            }
+            fixed *= 10;
+        }
+    } else if (exponent < -19) fixed = 0;
+    else {
+        u64 divisor = 1;
+        for (; exponent < 0; exponent += 1) divisor *= 10;
+        fixed = fixed / divisor + (fixed % divisor >= divisor - divisor / 2);
     }
-    assert(*i > start);
 
-    return (f32)f64_from_string(string_range(d, start, *i));
+    return negative ? -(i64)fixed : (i64)fixed;
 }
 
-static void swf_push_shapewithstyle(String_Builder *swf, SWF_Shape_With_Style shapes, SVG_Part part) {
-    // FILLSTYLEARRAY
-    push(swf, 1); // count
-    { // FILLSTYLE
-        assert(shapes.fill_style.type == 0); // solid
-        push(swf, shapes.fill_style.type);
+// NOTE(felix): arc flags are a single '0' or '1', and may be written with no separator before what follows
+static bool svg_path_read_flag(String d, u64 *i) {
+    svg_path_skip(d, i);
+    assert(*i < d.count && (d.data[*i] == '0' || d.data[*i] == '1'));
+    bool flag = d.data[*i] == '1';
+    (*i) += 1;
+    return flag;
+}
 
-        u32 rgba = shapes.fill_style.color;
-        push(swf, (u8)(rgba >> 24));
-        push(swf, (u8)(rgba >> 16));
-        push(swf, (u8)(rgba >> 8));
-        push(swf, (u8)(rgba >> 0));
-    }
+// NOTE(felix): path edges in absolute twips, exactly as the shape records encode them. Bounds are taken from these too, so they cover what is drawn
+typedef enum SWF_Edge_Kind {
+    SWF_Edge_Kind_MOVE,
+    SWF_Edge_Kind_LINE,
+    SWF_Edge_Kind_CURVE,
+    SWF_Edge_Kind_CUBIC, // NOTE(felix): only until the cubic kernel has run
+} SWF_Edge_Kind;
 
-    // LINESTYLEARRAY
-    push(swf, 1); // count
-    {
-        swf_write_u16(swf, shapes.line_style.width_twips);
+structdef(SWF_Edge) {
+    SWF_Edge_Kind kind;
+    union {
+        struct { i32 control_x, control_y; };
+        u32 cubic_index; // NOTE(felix): for SWF_Edge_Kind_CUBIC, which has no control point yet, the cubic's index in the Cubic_Batch
+    };
+    i32 x, y;
+};
 
-        u32 rgba = shapes.line_style.color;
-        push(swf, (u8)(rgba >> 24));
-        push(swf, (u8)(rgba >> 16));
-        push(swf, (u8)(rgba >> 8));
-        push(swf, (u8)(rgba >> 0));
-    }
+// NOTE(felix): a MoveTo and the edges drawn after it, up to the next MoveTo
+structdef(SWF_Subpath) {
+    u32 begin, end; // NOTE(felix): edge indices
+    u32 next_same_start; // NOTE(felix): the next subpath by index starting at the same point, or UINT32_MAX
+    bool used;
+};
 
-    push(swf, 0x11); // NumFillBits=1 (high nibble), NumLineBits=1 (low nibble)
+// NOTE(felix): cubics in structure-of-arrays layout, so that the kernels below can work on a register's width of them at once. Points are in twips, before rounding
+structdef(Cubic_Batch) {
+    Array_f32 x0, y0, x1, y1, x2, y2, x3, y3;
+    u32 *piece_counts; // how many quadratics each cubic becomes
+    u32 *first_pieces; // where each cubic's quadratics start in the Quadratic_Batch
+};
 
-    SWF_Bit_Writer bw = { .swf = swf };
+structdef(Quadratic_Batch) { f32 *control_x, *control_y, *x, *y; u64 count; };
 
-    if (part.kind == SVG_Part_Kind_PATH) {
-        String d = part.path.d;
-        assert(d.count != 0);
+#define CUBIC_MAX_PIECES 16
+#define CUBIC_TOLERANCE_TWIPS 1.f
 
-        u64 i = 0;
-        u8 cmd = 0;
+// NOTE(felix): a cubic is fitted with the quadratic whose control point is (3 (P1 + P2) - P0 - P3) / 4, which is off by at most
+// sqrt(3) / 36 |P3 - 3 P2 + 3 P1 - P0|. Cutting the cubic into n pieces divides that by n^3, so n pieces are enough once
+// n^6 >= |P3 - 3 P2 + 3 P1 - P0|^2 / (432 tolerance^2). These are the n^6 to compare against
+static const f32 cubic_piece_thresholds[CUBIC_MAX_PIECES - 1] = {
+    1, 64, 729, 4096, 15625, 46656, 117649, 262144, 531441, 1000000, 1771561, 2985984, 4826809, 7529536, 11390625,
+};
 
-        f32 cur_x = 0, cur_y = 0;
-        f32 sub_x = 0, sub_y = 0;
-        bool have_point = false;
+// NOTE(felix): every variant does the same f32 operations in the same order, and never fuses a multiply with an add, so all of them give identical pieces.
+// `ratio_scale` is 1 / (432 tolerance^2)
+typedef void Cubic_Piece_Counts_Function(Cubic_Batch *cubics, u64 begin, f32 ratio_scale);
+
+// NOTE(felix): the piece from t0 to t1 gets the control point (B(t0) + B(t1)) / 2 + (t1 - t0) / 4 (B'(t0) - B'(t1)), from the same fit as above.
+// B(t) is evaluated in power form, ((a t + b) t + c) t + P0, and each piece starts where the last one ended
+typedef void Cubic_Pieces_Function(Cubic_Batch *cubics, u64 begin, Quadratic_Batch *quadratics);
+
+static void cubic_piece_counts_scalar(Cubic_Batch *cubics, u64 begin, f32 ratio_scale) {
+    #if COMPILER_CLANG
+        #pragma STDC FP_CONTRACT OFF
+    #endif
+    for (u64 i = begin; i < cubics->x0.count; i += 1) {
+        f32 ax = (cubics->x3.data[i] - cubics->x0.data[i]) + (cubics->x1.data[i] - cubics->x2.data[i]) * 3.f;
+        f32 ay = (cubics->y3.data[i] - cubics->y0.data[i]) + (cubics->y1.data[i] - cubics->y2.data[i]) * 3.f;
+        f32 ratio = (ax * ax + ay * ay) * ratio_scale;
+
+        u32 pieces = 1;
+        for (u32 k = 0; k < CUBIC_MAX_PIECES - 1; k += 1) pieces += ratio > cubic_piece_thresholds[k];
+        cubics->piece_counts[i] = pieces;
+    }
+}
 
-        i32 last_x_tw = 0;
-        i32 last_y_tw = 0;
+static void cubic_pieces_scalar(Cubic_Batch *cubics, u64 begin, Quadratic_Batch *quadratics) {
+    #if COMPILER_CLANG
+        #pragma STDC FP_CONTRACT OFF
+    #endif
+    for (u64 i = begin; i < cubics->x0.count; i += 1) {
+        f32 x0 = cubics->x0.data[i], x1 = cubics->x1.data[i], x2 = cubics->x2.data[i], x3 = cubics->x3.data[i];
+        f32 y0 = cubics->y0.data[i], y1 = cubics->y1.data[i], y2 = cubics->y2.data[i], y3 = cubics->y3.data[i];
+
+        f32 ax = (x3 - x0) + (x1 - x2) * 3.f, bx = ((x2 - x1) - (x1 - x0)) * 3.f, cx = (x1 - x0) * 3.f;
+        f32 ay = (y3 - y0) + (y1 - y2) * 3.f, by = ((y2 - y1) - (y1 - y0)) * 3.f, cy = (y1 - y0) * 3.f;
+        f32 ax3 = ax * 3.f, bx2 = bx * 2.f, ay3 = ay * 3.f, by2 = by * 2.f;
+
+        u32 pieces = cubics->piece_counts[i];
+        f32 h = 1.f / (f32)pieces;
+        f32 quarter_h = h * 0.25f;
+
+        f32 from_x = x0, from_y = y0, from_dx = cx, from_dy = cy;
+        for (u32 p = 0; p < pieces; p += 1) {
+            f32 t = (f32)(p + 1) * h;
+            f32 to_x = ((ax * t + bx) * t + cx) * t + x0;
+            f32 to_y = ((ay * t + by) * t + cy) * t + y0;
+            f32 to_dx = (ax3 * t + bx2) * t + cx;
+            f32 to_dy = (ay3 * t + by2) * t + cy;
+
+            u64 q = cubics->first_pieces[i] + p;
+            quadratics->control_x[q] = (from_x + to_x) * 0.5f + (from_dx - to_dx) * quarter_h;
+            quadratics->control_y[q] = (from_y + to_y) * 0.5f + (from_dy - to_dy) * quarter_h;
+            quadratics->x[q] = to_x;
+            quadratics->y[q] = to_y;
+
+            from_x = to_x; from_y = to_y; from_dx = to_dx; from_dy = to_dy;
+        }
+    }
+}
 
-        while (i < d.count) {
-            svg_path_skip(d, &i);
-            if (i >= d.count) break;
+#if ARCH_X64
+static target_sse2 void cubic_piece_counts_sse2(Cubic_Batch *cubics, u64 begin, f32 ratio_scale) {
+    __m128 three = _mm_set1_ps(3.f), scale = _mm_set1_ps(ratio_scale);
 
-            if (svg_path_is_cmd(d.data[i])) {
-                cmd = d.data[i];
-                i += 1;
-            } else {
-                assert(cmd != 0);
-            }
+    u64 i = begin;
+    for (; i + 4 <= cubics->x0.count; i += 4) {
+        __m128 ax = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(cubics->x3.data + i), _mm_loadu_ps(cubics->x0.data + i)), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(cubics->x1.data + i), _mm_loadu_ps(cubics->x2.data + i)), three));
+        __m128 ay = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(cubics->y3.data + i), _mm_loadu_ps(cubics->y0.data + i)), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(cubics->y1.data + i), _mm_loadu_ps(cubics->y2.data + i)), three));
+        __m128 ratio = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), scale);
 
-            if (cmd == 'M' || cmd == 'm') {
-                f32 x = svg_path_read_f32(d, &i);
-                f32 y = svg_path_read_f32(d, &i);
+        // NOTE(felix): a true comparison is all ones, i.e. -1, so subtracting it counts
+        __m128i pieces = _mm_set1_epi32(1);
+        for (u32 k = 0; k < CUBIC_MAX_PIECES - 1; k += 1) {
+            pieces = _mm_sub_epi32(pieces, _mm_castps_si128(_mm_cmpgt_ps(ratio, _mm_set1_ps(cubic_piece_thresholds[k]))));
+        }
+        _mm_storeu_si128((__m128i *)(cubics->piece_counts + i), pieces);
+    }
 
-                if (cmd == 'm' && have_point) {
-                    x += cur_x;
-                    y += cur_y;
-                }
+    cubic_piece_counts_scalar(cubics, i, ratio_scale);
+}
 
-                cur_x = x;
-                cur_y = y;
-                sub_x = x;
-                sub_y = y;
-                have_point = true;
+static target_sse2 void cubic_pieces_sse2(Cubic_Batch *cubics, u64 begin, Quadratic_Batch *quadratics) {
+    __m128 two = _mm_set1_ps(2.f), three = _mm_set1_ps(3.f), half = _mm_set1_ps(0.5f), quarter = _mm_set1_ps(0.25f);
+
+    u64 i = begin;
+    for (; i + 4 <= cubics->x0.count; i += 4) {
+        __m128 x0 = _mm_loadu_ps(cubics->x0.data + i), x1 = _mm_loadu_ps(cubics->x1.data + i), x2 = _mm_loadu_ps(cubics->x2.data + i), x3 = _mm_loadu_ps(cubics->x3.data + i);
+        __m128 y0 = _mm_loadu_ps(cubics->y0.data + i), y1 = _mm_loadu_ps(cubics->y1.data + i), y2 = _mm_loadu_ps(cubics->y2.data + i), y3 = _mm_loadu_ps(cubics->y3.data + i);
+
+        __m128 ax = _mm_add_ps(_mm_sub_ps(x3, x0), _mm_mul_ps(_mm_sub_ps(x1, x2), three));
+        __m128 bx = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(x2, x1), _mm_sub_ps(x1, x0)), three);
+        __m128 cx = _mm_mul_ps(_mm_sub_ps(x1, x0), three);
+        __m128 ay = _mm_add_ps(_mm_sub_ps(y3, y0), _mm_mul_ps(_mm_sub_ps(y1, y2), three));
+        __m128 by = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(y2, y1), _mm_sub_ps(y1, y0)), three);
+        __m128 cy = _mm_mul_ps(_mm_sub_ps(y1, y0), three);
+        __m128 ax3 = _mm_mul_ps(ax, three), bx2 = _mm_mul_ps(bx, two), ay3 = _mm_mul_ps(ay, three), by2 = _mm_mul_ps(by, two);
+
+        u32 *pieces = cubics->piece_counts + i;
+        u32 most_pieces = MAX(MAX(pieces[0], pieces[1]), MAX(pieces[2], pieces[3]));
+        __m128 h = _mm_div_ps(_mm_set1_ps(1.f), _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)pieces)));
+        __m128 quarter_h = _mm_mul_ps(h, quarter);
+
+        __m128 from_x = x0, from_y = y0, from_dx = cx, from_dy = cy;
+        for (u32 p = 0; p < most_pieces; p += 1) {
+            __m128 t = _mm_mul_ps(_mm_set1_ps((f32)(p + 1)), h);
+            __m128 to_x = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ax, t), bx), t), cx), t), x0);
+            __m128 to_y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ay, t), by), t), cy), t), y0);
+            __m128 to_dx = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ax3, t), bx2), t), cx);
+            __m128 to_dy = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ay3, t), by2), t), cy);
+
+            f32 control_x[4], control_y[4], x[4], y[4];
+            _mm_storeu_ps(control_x, _mm_add_ps(_mm_mul_ps(_mm_add_ps(from_x, to_x), half), _mm_mul_ps(_mm_sub_ps(from_dx, to_dx), quarter_h)));
+            _mm_storeu_ps(control_y, _mm_add_ps(_mm_mul_ps(_mm_add_ps(from_y, to_y), half), _mm_mul_ps(_mm_sub_ps(from_dy, to_dy), quarter_h)));
+            _mm_storeu_ps(x, to_x);
+            _mm_storeu_ps(y, to_y);
+            for (u64 lane = 0; lane < 4; lane += 1) {
+                if (p >= pieces[lane]) continue;
+                u64 q = cubics->first_pieces[i + lane] + p;
+                quadratics->control_x[q] = control_x[lane];
+                quadratics->control_y[q] = control_y[lane];
+                quadratics->x[q] = x[lane];
+                quadratics->y[q] = y[lane];
+            }
 
-                {
-                    i32 x_tw = twips_from_svg_x(cur_x);
-                    i32 y_tw = twips_from_svg_y(cur_y);
-
-                    /* StyleChangeRecord: MoveTo + FillStyle0=1 + LineStyle=1 */
-                    swf_bw_push_bit(&bw, 0);
-
-                    swf_bw_push_bit(&bw, 0);
-                    swf_bw_push_bit(&bw, 1);
-                    swf_bw_push_bit(&bw, 0);
-                    swf_bw_push_bit(&bw, 1);
-                    swf_bw_push_bit(&bw, 1);
-
-                    {
-                        u32 mx = swf_sbits_width(x_tw);
-                        u32 my = swf_sbits_width(y_tw);
-                        u32 move_bits = (mx > my) ? mx : my;
-                        if (move_bits < 1) move_bits = 1;
-                        if (move_bits > 31) move_bits = 31;
-
-                        swf_bw_push_ubits(&bw, move_bits, 5);
-                        swf_bw_push_sbits(&bw, x_tw, move_bits);
-                        swf_bw_push_sbits(&bw, y_tw, move_bits);
-                    }
+            from_x = to_x; from_y = to_y; from_dx = to_dx; from_dy = to_dy;
+        }
+    }
 
-                    swf_bw_push_ubits(&bw, 1, 1);
-                    swf_bw_push_ubits(&bw, 1, 1);
+    cubic_pieces_scalar(cubics, i, quadratics);
+}
 
-                    last_x_tw = x_tw;
-                    last_y_tw = y_tw;
-                }
+static target_avx2 void cubic_piece_counts_avx2(Cubic_Batch *cubics, u64 begin, f32 ratio_scale) {
+    __m256 three = _mm256_set1_ps(3.f), scale = _mm256_set1_ps(ratio_scale);
 
-                /* implicit lineto for extra pairs */
-                while (1) {
-                    svg_path_skip(d, &i);
-                    if (i >= d.count) break;
-                    if (svg_path_is_cmd(d.data[i])) break;
-
-                    f32 lx = svg_path_read_f32(d, &i);
-                    f32 ly = svg_path_read_f32(d, &i);
-                    if (cmd == 'm') {
-                        lx += cur_x;
-                        ly += cur_y;
-                    }
+    u64 i = begin;
+    for (; i + 8 <= cubics->x0.count; i += 8) {
+        __m256 ax = _mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(cubics->x3.data + i), _mm256_loadu_ps(cubics->x0.data + i)), _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(cubics->x1.data + i), _mm256_loadu_ps(cubics->x2.data + i)), three));
+        __m256 ay = _mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(cubics->y3.data + i), _mm256_loadu_ps(cubics->y0.data + i)), _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(cubics->y1.data + i), _mm256_loadu_ps(cubics->y2.data + i)), three));
+        __m256 ratio = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay)), scale);
 
-                    {
-                        i32 nx_tw = twips_from_svg_x(lx);
-                        i32 ny_tw = twips_from_svg_y(ly);
+        __m256i pieces = _mm256_set1_epi32(1);
+        for (u32 k = 0; k < CUBIC_MAX_PIECES - 1; k += 1) {
+            pieces = _mm256_sub_epi32(pieces, _mm256_castps_si256(_mm256_cmp_ps(ratio, _mm256_set1_ps(cubic_piece_thresholds[k]), _CMP_GT_OQ)));
+        }
+        _mm256_storeu_si256((__m256i *)(cubics->piece_counts + i), pieces);
+    }
 
-                        i32 dx = nx_tw - last_x_tw;
-                        i32 dy = ny_tw - last_y_tw;
+    cubic_piece_counts_scalar(cubics, i, ratio_scale);
+}
 
-                        swf_bw_push_bit(&bw, 1);
-                        swf_bw_push_bit(&bw, 1);
+static target_avx2 void cubic_pieces_avx2(Cubic_Batch *cubics, u64 begin, Quadratic_Batch *quadratics) {
+    __m256 two = _mm256_set1_ps(2.f), three = _mm256_set1_ps(3.f), half = _mm256_set1_ps(0.5f), quarter = _mm256_set1_ps(0.25f);
+
+    u64 i = begin;
+    for (; i + 8 <= cubics->x0.count; i += 8) {
+        __m256 x0 = _mm256_loadu_ps(cubics->x0.data + i), x1 = _mm256_loadu_ps(cubics->x1.data + i), x2 = _mm256_loadu_ps(cubics->x2.data + i), x3 = _mm256_loadu_ps(cubics->x3.data + i);
+        __m256 y0 = _mm256_loadu_ps(cubics->y0.data + i), y1 = _mm256_loadu_ps(cubics->y1.data + i), y2 = _mm256_loadu_ps(cubics->y2.data + i), y3 = _mm256_loadu_ps(cubics->y3.data + i);
+
+        __m256 ax = _mm256_add_ps(_mm256_sub_ps(x3, x0), _mm256_mul_ps(_mm256_sub_ps(x1, x2), three));
+        __m256 bx = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(x2, x1), _mm256_sub_ps(x1, x0)), three);
+        __m256 cx = _mm256_mul_ps(_mm256_sub_ps(x1, x0), three);
+        __m256 ay = _mm256_add_ps(_mm256_sub_ps(y3, y0), _mm256_mul_ps(_mm256_sub_ps(y1, y2), three));
+        __m256 by = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(y2, y1), _mm256_sub_ps(y1, y0)), three);
+        __m256 cy = _mm256_mul_ps(_mm256_sub_ps(y1, y0), three);
+        __m256 ax3 = _mm256_mul_ps(ax, three), bx2 = _mm256_mul_ps(bx, two), ay3 = _mm256_mul_ps(ay, three), by2 = _mm256_mul_ps(by, two);
+
+        u32 *pieces = cubics->piece_counts + i;
+        u32 most_pieces = 0;
+        for (u64 lane = 0; lane < 8; lane += 1) most_pieces = MAX(most_pieces, pieces[lane]);
+        __m256 h = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)pieces)));
+        __m256 quarter_h = _mm256_mul_ps(h, quarter);
+
+        __m256 from_x = x0, from_y = y0, from_dx = cx, from_dy = cy;
+        for (u32 p = 0; p < most_pieces; p += 1) {
+            __m256 t = _mm256_mul_ps(_mm256_set1_ps((f32)(p + 1)), h);
+            __m256 to_x = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ax, t), bx), t), cx), t), x0);
+            __m256 to_y = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ay, t), by), t), cy), t), y0);
+            __m256 to_dx = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ax3, t), bx2), t), cx);
+            __m256 to_dy = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ay3, t), by2), t), cy);
+
+            f32 control_x[8], control_y[8], x[8], y[8];
+            _mm256_storeu_ps(control_x, _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(from_x, to_x), half), _mm256_mul_ps(_mm256_sub_ps(from_dx, to_dx), quarter_h)));
+            _mm256_storeu_ps(control_y, _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(from_y, to_y), half), _mm256_mul_ps(_mm256_sub_ps(from_dy, to_dy), quarter_h)));
+            _mm256_storeu_ps(x, to_x);
+            _mm256_storeu_ps(y, to_y);
+            for (u64 lane = 0; lane < 8; lane += 1) {
+                if (p >= pieces[lane]) continue;
+                u64 q = cubics->first_pieces[i + lane] + p;
+                quadratics->control_x[q] = control_x[lane];
+                quadratics->control_y[q] = control_y[lane];
+                quadratics->x[q] = x[lane];
+                quadratics->y[q] = y[lane];
+            }
 
-                        {
-                            u32 nx = swf_sbits_width(dx);
-                            u32 ny = swf_sbits_width(dy);
-                            u32 n = (nx > ny) ? nx : ny;
-                            if (n < 2) n = 2;
-                            if (n > 31) n = 31;
+            from_x = to_x; from_y = to_y; from_dx = to_dx; from_dy = to_dy;
+        }
+    }
 
-                            swf_bw_push_ubits(&bw, n - 2, 4);
-                            swf_bw_push_bit(&bw, 1);
-                            swf_bw_push_sbits(&bw, dx, n);
-                            swf_bw_push_sbits(&bw, dy, n);
-                        }
+    cubic_pieces_scalar(cubics, i, quadratics);
+}
+#endif // ARCH_X64
+
+// NOTE(felix): AVX-512 would only widen the lanes that wait on the cubic with the most pieces, so it uses the AVX2 variants
+static Cubic_Piece_Counts_Function *cubic_piece_counts_variants[Cpu_Isa_COUNT] = {
+    [Cpu_Isa_SCALAR] = cubic_piece_counts_scalar,
+    #if ARCH_X64
+        [Cpu_Isa_SSE2] = cubic_piece_counts_sse2,
+        [Cpu_Isa_AVX2] = cubic_piece_counts_avx2,
+        [Cpu_Isa_AVX512] = cubic_piece_counts_avx2,
+    #endif
+};
 
-                        last_x_tw = nx_tw;
-                        last_y_tw = ny_tw;
-                    }
+static Cubic_Pieces_Function *cubic_pieces_variants[Cpu_Isa_COUNT] = {
+    [Cpu_Isa_SCALAR] = cubic_pieces_scalar,
+    #if ARCH_X64
+        [Cpu_Isa_SSE2] = cubic_pieces_sse2,
+        [Cpu_Isa_AVX2] = cubic_pieces_avx2,
+        [Cpu_Isa_AVX512] = cubic_pieces_avx2,
+    #endif
+};
 
-                    cur_x = lx;
-                    cur_y = ly;
-                }
-            } else if (cmd == 'L' || cmd == 'l') {
-                assert(have_point);
+// NOTE(felix): returns how many quadratics the cubics become. `snap_twips` is how far points move when they are snapped to the grid, which the fit may use too
+static u64 cubic_batch_count_pieces(Arena *arena, Cubic_Batch *cubics, f32 snap_twips) {
+    u64 count = cubics->x0.count;
+    cubics->piece_counts = arena_make(arena, count, u32);
+    cubics->first_pieces = arena_make(arena, count, u32);
 
-                while (1) {
-                    svg_path_skip(d, &i);
-                    if (i >= d.count) break;
-                    if (svg_path_is_cmd(d.data[i])) break;
+    f32 tolerance = MAX(CUBIC_TOLERANCE_TWIPS, snap_twips);
+    cubic_piece_counts_variants[g_isa](cubics, 0, 1.f / (432.f * tolerance * tolerance));
 
-                    f32 x = svg_path_read_f32(d, &i);
-                    f32 y = svg_path_read_f32(d, &i);
-                    if (cmd == 'l') {
-                        x += cur_x;
-                        y += cur_y;
-                    }
+    u64 piece_count = 0;
+    for (u64 i = 0; i < count; i += 1) {
+        cubics->first_pieces[i] = (u32)piece_count;
+        piece_count += cubics->piece_counts[i];
+    }
+    return piece_count;
+}
 
-                    {
-                        i32 nx_tw = twips_from_svg_x(x);
-                        i32 ny_tw = twips_from_svg_y(y);
+// NOTE(felix): after cubic_batch_count_pieces(), which gave `piece_count`
+static Quadratic_Batch cubic_batch_to_quadratics(Arena *arena, Cubic_Batch *cubics, u64 piece_count) {
+    Quadratic_Batch quadratics = { .count = piece_count };
+    quadratics.control_x = arena_make(arena, quadratics.count, f32);
+    quadratics.control_y = arena_make(arena, quadratics.count, f32);
+    quadratics.x = arena_make(arena, quadratics.count, f32);
+    quadratics.y = arena_make(arena, quadratics.count, f32);
 
-                        i32 dx = nx_tw - last_x_tw;
-                        i32 dy = ny_tw - last_y_tw;
+    cubic_pieces_variants[g_isa](cubics, 0, &quadratics);
+    return quadratics;
+}
 
-                        swf_bw_push_bit(&bw, 1);
-                        swf_bw_push_bit(&bw, 1);
+// NOTE(felix): the largest error, in twips, allowed between an arc and the quadratics that stand in for it
+#define ARC_TOLERANCE_TWIPS 1.f
+
+// NOTE(felix): an elliptical arc as quadratic curves, following the endpoint to centre conversion in the SVG implementation notes.
+// The unit circle is cut into equal pieces, each of which gets the quadratic through its end points whose control point is where their tangents meet.
+// That bulges out from a circle of radius r by about r a^4 / 8 at half angle a, which sets the number of pieces. Mapping the circle onto the ellipse keeps the tangents.
+// Returns how many edges the arc becomes, which are only pushed if there are no more than `edge_limit`
+static u64 swf_push_arc(Array_SWF_Edge *edges, i64 x1_, i64 y1_, i64 rx_, i64 ry_, i64 rotation_degrees, bool large_arc, bool sweep, i64 x2_, i64 y2_, f32 snap_twips, u64 edge_limit) {
+    i32 end_x = twips_from_fixed_x(x2_);
+    i32 end_y = twips_from_fixed_y(y2_);
+    if (x1_ == x2_ && y1_ == y2_) return 0;
+
+    f64 one = SVG_FIXED_ONE;
+    f64 x1 = (f64)x1_ / one, y1 = (f64)y1_ / one, x2 = (f64)x2_ / one, y2 = (f64)y2_ / one;
+    f64 rx = fabs((f64)rx_ / one), ry = fabs((f64)ry_ / one);
+    if (rx == 0 || ry == 0) {
+        if (edge_limit >= 1) push(edges, ((SWF_Edge){ .kind = SWF_Edge_Kind_LINE, .x = end_x, .y = end_y }));
+        return 1;
+    }
 
-                        {
-                            u32 nx = swf_sbits_width(dx);
-                            u32 ny = swf_sbits_width(dy);
-                            u32 n = (nx > ny) ? nx : ny;
-                            if (n < 2) n = 2;
-                            if (n > 31) n = 31;
+    f64 rotation = (f64)rotation_degrees / one * pi_f64 / 180;
+    f64 cos_r = cos(rotation), sin_r = sin(rotation);
 
-                            swf_bw_push_ubits(&bw, n - 2, 4);
-                            swf_bw_push_bit(&bw, 1);
-                            swf_bw_push_sbits(&bw, dx, n);
-                            swf_bw_push_sbits(&bw, dy, n);
-                        }
+    f64 half_dx = (x1 - x2) / 2, half_dy = (y1 - y2) / 2;
+    f64 x1p = cos_r * half_dx + sin_r * half_dy;
+    f64 y1p = -sin_r * half_dx + cos_r * half_dy;
 
-                        last_x_tw = nx_tw;
-                        last_y_tw = ny_tw;
-                    }
+    // NOTE(felix): radii too small to reach the end point are scaled up until they just do
+    f64 lambda = (x1p * x1p) / (rx * rx) + (y1p * y1p) / (ry * ry);
+    if (lambda > 1) {
+        rx *= sqrt(lambda);
+        ry *= sqrt(lambda);
+    }
 
-                    cur_x = x;
-                    cur_y = y;
-                }
-            } else if (cmd == 'C' || cmd == 'c') {
-                assert(have_point);
+    f64 numerator = rx * rx * ry * ry - rx * rx * y1p * y1p - ry * ry * x1p * x1p;
+    f64 denominator = rx * rx * y1p * y1p + ry * ry * x1p * x1p;
+    f64 coefficient = sqrt(MAX(0, numerator / denominator));
+    if (large_arc == sweep) coefficient = -coefficient;
+    f64 cxp = coefficient * rx * y1p / ry;
+    f64 cyp = coefficient * -ry * x1p / rx;
+
+    f64 cx = cos_r * cxp - sin_r * cyp + (x1 + x2) / 2;
+    f64 cy = sin_r * cxp + cos_r * cyp + (y1 + y2) / 2;
+
+    f64 start_angle = atan2((y1p - cyp) / ry, (x1p - cxp) / rx);
+    f64 end_angle = atan2((-y1p - cyp) / ry, (-x1p - cxp) / rx);
+    f64 sweep_angle = end_angle - start_angle;
+    if (!sweep && sweep_angle > 0) sweep_angle -= 2 * pi_f64;
+    if (sweep && sweep_angle < 0) sweep_angle += 2 * pi_f64;
+
+    // NOTE(felix): past twice the largest coordinate, the arc can't be drawn as it is anyway, so that bounds the pieces a whole turn needs (about 400)
+    f64 radius_twips = MAX(rx * fabs(g_viewbox.twips_per_fixed_x), ry * fabs(g_viewbox.twips_per_fixed_y)) * one;
+    radius_twips = MIN(radius_twips, 2.0 * SWF_TWIPS_MAX);
+    f64 max_half_angle = pow(8 * (f64)MAX(ARC_TOLERANCE_TWIPS, snap_twips) / MAX(radius_twips, 1), 0.25);
+    u32 pieces = (u32)ceil(fabs(sweep_angle) / (2 * MIN(max_half_angle, pi_f64 / 4)));
+    pieces = MAX(pieces, 1);
+    if (pieces > edge_limit) return pieces;
+
+    f64 half_angle = sweep_angle / (2 * pieces);
+    f64 bulge = 1 / cos(half_angle);
+    for (u32 p = 0; p < pieces; p += 1) {
+        f64 middle = start_angle + (2 * p + 1) * half_angle;
+        f64 to = start_angle + (2 * p + 2) * half_angle;
+
+        f64 ux = rx * cos(middle) * bulge, uy = ry * sin(middle) * bulge;
+        f64 control_x = cx + cos_r * ux - sin_r * uy;
+        f64 control_y = cy + sin_r * ux + cos_r * uy;
+
+        f64 vx = rx * cos(to), vy = ry * sin(to);
+        SWF_Edge curve = {
+            .kind = SWF_Edge_Kind_CURVE,
+            .control_x = twips_from_fixed_x(fixed_from_svg(control_x)), .control_y = twips_from_fixed_y(fixed_from_svg(control_y)),
+            .x = twips_from_fixed_x(fixed_from_svg(cx + cos_r * vx - sin_r * vy)), .y = twips_from_fixed_y(fixed_from_svg(cy + sin_r * vx + cos_r * vy)),
+        };
+        // NOTE(felix): the last piece ends exactly where the next edge starts
+        if (p + 1 == pieces) {
+            curve.x = end_x;
+            curve.y = end_y;
+        }
+        push(edges, curve);
+    }
+    return pieces;
+}
 
-                while (1) {
-                    svg_path_skip(d, &i);
-                    if (i >= d.count) break;
-                    if (svg_path_is_cmd(d.data[i])) break;
-
-                    f32 x1 = svg_path_read_f32(d, &i);
-                    f32 y1 = svg_path_read_f32(d, &i);
-                    f32 x2 = svg_path_read_f32(d, &i);
-                    f32 y2 = svg_path_read_f32(d, &i);
-                    f32 x3 = svg_path_read_f32(d, &i);
-                    f32 y3 = svg_path_read_f32(d, &i);
-
-                    if (cmd == 'c') {
-                        x1 += cur_x; y1 += cur_y;
-                        x2 += cur_x; y2 += cur_y;
-                        x3 += cur_x; y3 += cur_y;
-                    }
+// NOTE(felix): the scratch a path needs while it's encoded. Until cubics become quadratics, each character of path data adds at most one edge to an array
+// that leaves its smaller buffers behind as it grows, and a cubic, which takes at least 6 characters, adds its points to eight more such arrays.
+// Each edge after that takes as much again in the parser's array, one in the copy with quadratics for cubics, the quadratic's points,
+// and for joining, a subpath in a growing array, up to 3 map slots (at MAP_MAX_LOAD_FACTOR, rounded up to a power of 2), and the joined copy
+#define SWF_PATH_SCRATCH_BYTES_BASE (16 * 1024 * 1024)
+#define SWF_PATH_SCRATCH_BYTES_PER_CHARACTER (4 * sizeof(SWF_Edge) + (8 * 4 * sizeof(f32) + 2 * sizeof(u32)) / 6)
+#define SWF_PATH_SCRATCH_BYTES_PER_EDGE (6 * sizeof(SWF_Edge) + 4 * sizeof(f32) + 4 * sizeof(SWF_Subpath) + 3 * (2 * sizeof(u64) + sizeof(u32)))
 
-                    f32 x0 = cur_x;
-                    f32 y0 = cur_y;
-
-                    u32 segments = 16;
-                    for (u32 s = 1; s <= segments; s += 1) {
-                        f32 t = (f32)s / (f32)segments;
-                        f32 it = 1.0f - t;
-
-                        f32 bx =
-                            it*it*it*x0 +
-                            3.0f*it*it*t*x1 +
-                            3.0f*it*t*t*x2 +
-                            t*t*t*x3;
-
-                        f32 by =
-                            it*it*it*y0 +
-                            3.0f*it*it*t*y1 +
-                            3.0f*it*t*t*y2 +
-                            t*t*t*y3;
-
-                        i32 nx_tw = twips_from_svg_x(bx);
-                        i32 ny_tw = twips_from_svg_y(by);
-
-                        i32 dx = nx_tw - last_x_tw;
-                        i32 dy = ny_tw - last_y_tw;
-
-                        swf_bw_push_bit(&bw, 1);
-                        swf_bw_push_bit(&bw, 1);
-
-                        {
-                            u32 nx = swf_sbits_width(dx);
-                            u32 ny = swf_sbits_width(dy);
-                            u32 n = (nx > ny) ? nx : ny;
-                            if (n < 2) n = 2;
-                            if (n > 31) n = 31;
-
-                            swf_bw_push_ubits(&bw, n - 2, 4);
-                            swf_bw_push_bit(&bw, 1);
-                            swf_bw_push_sbits(&bw, dx, n);
-                            swf_bw_push_sbits(&bw, dy, n);
-                        }
-
-                        last_x_tw = nx_tw;
-                        last_y_tw = ny_tw;
-                    }
+static u64 swf_path_scratch_bytes(u64 character_count, u64 edge_count) {
+    return SWF_PATH_SCRATCH_BYTES_BASE + character_count * SWF_PATH_SCRATCH_BYTES_PER_CHARACTER + edge_count * SWF_PATH_SCRATCH_BYTES_PER_EDGE;
+}
 
-                    cur_x = x3;
-                    cur_y = y3;
-                }
-            } else if (cmd == 'Z' || cmd == 'z') {
-                assert(have_point);
+// NOTE(felix): how many edges a path of `character_count` characters may become in what's left of `arena`
+static u64 swf_path_edge_room(Arena *arena, u64 character_count) {
+    u64 left = arena->capacity - arena->offset;
+    u64 parsing = SWF_PATH_SCRATCH_BYTES_BASE / 16 + character_count * SWF_PATH_SCRATCH_BYTES_PER_CHARACTER;
+    return left > parsing ? (left - parsing) / SWF_PATH_SCRATCH_BYTES_PER_EDGE : 0;
+}
 
-                {
-                    i32 sx_tw = twips_from_svg_x(sub_x);
-                    i32 sy_tw = twips_from_svg_y(sub_y);
+// NOTE(felix): reads every path command, with their implicit repeats. Curves may be off by `snap_twips`, as for cubic_batch_count_pieces.
+// `edge_count` is set to how many edges the path becomes. If that's more than `edge_limit`, nothing more is done and no edges are returned
+static Array_SWF_Edge swf_edges_from_path(Arena *arena, String d, f32 snap_twips, u64 edge_limit, u64 *edge_count) {
+    assert(d.count != 0);
 
-                    if (sx_tw != last_x_tw || sy_tw != last_y_tw) {
-                        i32 dx = sx_tw - last_x_tw;
-                        i32 dy = sy_tw - last_y_tw;
+    Array_SWF_Edge edges = { .arena = arena };
+    Cubic_Batch cubics = {
+        .x0 = { .arena = arena }, .y0 = { .arena = arena }, .x1 = { .arena = arena }, .y1 = { .arena = arena },
+        .x2 = { .arena = arena }, .y2 = { .arena = arena }, .x3 = { .arena = arena }, .y3 = { .arena = arena },
+    };
 
-                        swf_bw_push_bit(&bw, 1);
-                        swf_bw_push_bit(&bw, 1);
+    u64 i = 0;
+    u8 cmd = 0;
 
-                        {
-                            u32 nx = swf_sbits_width(dx);
-                            u32 ny = swf_sbits_width(dy);
-                            u32 n = (nx > ny) ? nx : ny;
-                            if (n < 2) n = 2;
-                            if (n > 31) n = 31;
+    i64 cur_x = 0, cur_y = 0;
+    i64 sub_x = 0, sub_y = 0;
+    bool have_point = false;
+    u64 skipped_edge_count = 0; // NOTE(felix): arc pieces past `edge_limit`
 
-                            swf_bw_push_ubits(&bw, n - 2, 4);
-                            swf_bw_push_bit(&bw, 1);
-                            swf_bw_push_sbits(&bw, dx, n);
-                            swf_bw_push_sbits(&bw, dy, n);
-                        }
+    // NOTE(felix): S and T reflect the previous command's last control point, but only when that command was a cubic or a quadratic respectively
+    i64 control_x = 0, control_y = 0;
+    u8 control_from = 0; // 'C' or 'Q', or 0
 
-                        last_x_tw = sx_tw;
-                        last_y_tw = sy_tw;
-                    }
-                }
+    while (i < d.count) {
+        svg_path_skip(d, &i);
+        if (i >= d.count) break;
 
-                cur_x = sub_x;
-                cur_y = sub_y;
-            } else {
-                panic("unsupported SVG path command");
-            }
+        if (svg_path_is_cmd(d.data[i])) {
+            cmd = d.data[i];
+            i += 1;
+        } else {
+            assert(cmd != 0);
         }
-    } else if (part.kind == SVG_Part_Kind_RECT) {
-        i32 x0 = twips_from_svg_x(part.rect.position.x);
-        i32 y0 = twips_from_svg_y(part.rect.position.y);
-        i32 w  = twips_from_svg_dx(part.rect.size.x);
-        i32 h  = twips_from_svg_dy(part.rect.size.y);
 
-        /* StyleChangeRecord: MoveTo + FillStyle0=1 + LineStyle=1 */
-        swf_bw_push_bit(&bw, 0); /* TypeFlag: non-edge */
+        bool relative = ascii_is_lower(cmd);
+        i64 base_x = relative ? cur_x : 0;
+        i64 base_y = relative ? cur_y : 0;
+        u8 next_control_from = 0;
 
-        swf_bw_push_bit(&bw, 0); /* StateNewStyles */
-        swf_bw_push_bit(&bw, 1); /* StateLineStyle */
-        swf_bw_push_bit(&bw, 0); /* StateFillStyle1 */
-        swf_bw_push_bit(&bw, 1); /* StateFillStyle0 */
-        swf_bw_push_bit(&bw, 1); /* StateMoveTo */
+        switch (ascii_to_upper(cmd)) {
+            case 'M': {
+                i64 x = svg_path_read_fixed(d, &i);
+                i64 y = svg_path_read_fixed(d, &i);
 
-        {
-            u32 mx = swf_sbits_width(x0);
-            u32 my = swf_sbits_width(y0);
-            u32 move_bits = (mx > my) ? mx : my;
-            if (move_bits < 1) move_bits = 1;
-            if (move_bits > 31) move_bits = 31;
+                // NOTE(felix): a path's first 'm' is absolute
+                if (relative && have_point) {
+                    x += cur_x;
+                    y += cur_y;
+                }
 
-            swf_bw_push_ubits(&bw, move_bits, 5);
-            swf_bw_push_sbits(&bw, x0, move_bits);
-            swf_bw_push_sbits(&bw, y0, move_bits);
-        }
+                cur_x = x;
+                cur_y = y;
+                sub_x = x;
+                sub_y = y;
+                have_point = true;
 
-        swf_bw_push_ubits(&bw, 1, 1); /* FillStyle0 index (NumFillBits=1) */
-        swf_bw_push_ubits(&bw, 1, 1); /* LineStyle index (NumLineBits=1) */
+                push(&edges, ((SWF_Edge){ .kind = SWF_Edge_Kind_MOVE, .x = twips_from_fixed_x(x), .y = twips_from_fixed_y(y) }));
 
-        /* 4 StraightEdgeRecords (axis-aligned) */
-        {
-            i32 dx[4] = { +w,  0, -w,  0 };
-            i32 dy[4] = {  0, +h,  0, -h };
-
-            for (u32 e = 0; e < 4; e += 1) {
-                i32 edx = dx[e];
-                i32 edy = dy[e];
-
-                swf_bw_push_bit(&bw, 1); /* TypeFlag: edge */
-                swf_bw_push_bit(&bw, 1); /* StraightFlag: straight */
-
-                if (edy == 0) {
-                    u32 n = swf_sbits_width(edx);
-                    if (n < 2) n = 2;
-                    swf_bw_push_ubits(&bw, n - 2, 4); /* NumBits */
-                    swf_bw_push_bit(&bw, 0);          /* GeneralLineFlag */
-                    swf_bw_push_bit(&bw, 0);          /* VertLineFlag=0 => horizontal */
-                    swf_bw_push_sbits(&bw, edx, n);   /* DeltaX */
-                } else {
-                    u32 n = swf_sbits_width(edy);
-                    if (n < 2) n = 2;
-                    swf_bw_push_ubits(&bw, n - 2, 4); /* NumBits */
-                    swf_bw_push_bit(&bw, 0);          /* GeneralLineFlag */
-                    swf_bw_push_bit(&bw, 1);          /* VertLineFlag=1 => vertical */
-                    swf_bw_push_sbits(&bw, edy, n);   /* DeltaY */
-                }
-            }
-        }
-    } else {
-        assert(part.kind == SVG_Part_Kind_ELLIPSE);
+                /* implicit lineto for extra pairs */
+                cmd = relative ? 'l' : 'L';
+            } break;
+            case 'L': case 'H': case 'V': {
+                assert(have_point);
 
-        i32 cx = twips_from_svg_x(part.ellipse.centre.x);
-        i32 cy = twips_from_svg_y(part.ellipse.centre.y);
-        i32 rx = twips_from_svg_dx(part.ellipse.radius.x);
-        i32 ry = twips_from_svg_dy(part.ellipse.radius.y);
+                i64 x = cur_x, y = cur_y;
+                if (ascii_to_upper(cmd) != 'V') x = base_x + svg_path_read_fixed(d, &i);
+                if (ascii_to_upper(cmd) != 'H') y = base_y + svg_path_read_fixed(d, &i);
 
-        assert(rx >= 0 && ry >= 0);
+                push(&edges, ((SWF_Edge){ .kind = SWF_Edge_Kind_LINE, .x = twips_from_fixed_x(x), .y = twips_from_fixed_y(y) }));
+
+                cur_x = x;
+                cur_y = y;
+            } break;
+            case 'C': case 'S': {
+                assert(have_point);
+
+                i64 x1 = 2 * cur_x - control_x, y1 = 2 * cur_y - control_y;
+                if (control_from != 'C') {
+                    x1 = cur_x;
+                    y1 = cur_y;
+                }
+                if (ascii_to_upper(cmd) == 'C') {
+                    x1 = base_x + svg_path_read_fixed(d, &i);
+                    y1 = base_y + svg_path_read_fixed(d, &i);
+                }
+                i64 x2 = base_x + svg_path_read_fixed(d, &i);
+                i64 y2 = base_y + svg_path_read_fixed(d, &i);
+                i64 x3 = base_x + svg_path_read_fixed(d, &i);
+                i64 y3 = base_y + svg_path_read_fixed(d, &i);
+
+                push(&edges, ((SWF_Edge){ .kind = SWF_Edge_Kind_CUBIC, .cubic_index = (u32)cubics.x0.count, .x = twips_from_fixed_x(x3), .y = twips_from_fixed_y(y3) }));
+                push(&cubics.x0, (f32)twips_unrounded_from_fixed_x(cur_x)); push(&cubics.y0, (f32)twips_unrounded_from_fixed_y(cur_y));
+                push(&cubics.x1, (f32)twips_unrounded_from_fixed_x(x1)); push(&cubics.y1, (f32)twips_unrounded_from_fixed_y(y1));
+                push(&cubics.x2, (f32)twips_unrounded_from_fixed_x(x2)); push(&cubics.y2, (f32)twips_unrounded_from_fixed_y(y2));
+                push(&cubics.x3, (f32)twips_unrounded_from_fixed_x(x3)); push(&cubics.y3, (f32)twips_unrounded_from_fixed_y(y3));
+
+                control_x = x2;
+                control_y = y2;
+                next_control_from = 'C';
+                cur_x = x3;
+                cur_y = y3;
+            } break;
+            case 'Q': case 'T': {
+                assert(have_point);
+
+                // NOTE(felix): SWF curves are quadratic, so these need no approximation
+                i64 x1 = 2 * cur_x - control_x, y1 = 2 * cur_y - control_y;
+                if (control_from != 'Q') {
+                    x1 = cur_x;
+                    y1 = cur_y;
+                }
+                if (ascii_to_upper(cmd) == 'Q') {
+                    x1 = base_x + svg_path_read_fixed(d, &i);
+                    y1 = base_y + svg_path_read_fixed(d, &i);
+                }
+                i64 x = base_x + svg_path_read_fixed(d, &i);
+                i64 y = base_y + svg_path_read_fixed(d, &i);
+
+                SWF_Edge curve = {
+                    .kind = SWF_Edge_Kind_CURVE,
+                    .control_x = twips_from_fixed_x(x1), .control_y = twips_from_fixed_y(y1),
+                    .x = twips_from_fixed_x(x), .y = twips_from_fixed_y(y),
+                };
+                push(&edges, curve);
+
+                control_x = x1;
+                control_y = y1;
+                next_control_from = 'Q';
+                cur_x = x;
+                cur_y = y;
+            } break;
+            case 'A': {
+                assert(have_point);
+
+                i64 rx = svg_path_read_fixed(d, &i);
+                i64 ry = svg_path_read_fixed(d, &i);
+                i64 rotation = svg_path_read_fixed(d, &i);
+                bool large_arc = svg_path_read_flag(d, &i);
+                bool sweep = svg_path_read_flag(d, &i);
+                i64 x = base_x + svg_path_read_fixed(d, &i);
+                i64 y = base_y + svg_path_read_fixed(d, &i);
+
+                // NOTE(felix): the only command whose edges don't grow with its length in the path data. Once they've gone past `edge_limit`, the rest are only counted
+                u64 arc_limit = skipped_edge_count == 0 && edge_limit > edges.count ? edge_limit - edges.count : 0;
+                u64 arc_edge_count = swf_push_arc(&edges, cur_x, cur_y, rx, ry, rotation, large_arc, sweep, x, y, snap_twips, arc_limit);
+                if (arc_edge_count > arc_limit) skipped_edge_count += arc_edge_count;
+
+                cur_x = x;
+                cur_y = y;
+            } break;
+            case 'Z': {
+                assert(have_point);
+
+                SWF_Edge *last = slice_get_last(edges);
+                i32 sx_tw = twips_from_fixed_x(sub_x);
+                i32 sy_tw = twips_from_fixed_y(sub_y);
+                if (sx_tw != last->x || sy_tw != last->y) push(&edges, ((SWF_Edge){ .kind = SWF_Edge_Kind_LINE, .x = sx_tw, .y = sy_tw }));
+
+                cur_x = sub_x;
+                cur_y = sub_y;
+            } break;
+            default: {
+                panic("unsupported SVG path command");
+            } break;
+        }
+
+        control_from = next_control_from;
+    }
+
+    *edge_count = edges.count + skipped_edge_count;
+    if (*edge_count > edge_limit) return (Array_SWF_Edge){0};
+    if (cubics.x0.count == 0) return edges;
+
+    u64 piece_count = cubic_batch_count_pieces(arena, &cubics, snap_twips);
+    *edge_count = edges.count - cubics.x0.count + piece_count;
+    if (*edge_count > edge_limit) return (Array_SWF_Edge){0};
+
+    Quadratic_Batch quadratics = cubic_batch_to_quadratics(arena, &cubics, piece_count);
+
+    Array_SWF_Edge curved = { .arena = arena };
+    reserve(&curved, edges.count - cubics.x0.count + quadratics.count);
+    for_slice (SWF_Edge *, edge, edges) {
+        if (edge->kind != SWF_Edge_Kind_CUBIC) {
+            push(&curved, *edge);
+            continue;
+        }
+
+        u64 cubic = edge->cubic_index;
+        u64 first = cubics.first_pieces[cubic];
+        u64 end = first + cubics.piece_counts[cubic];
+        for (u64 q = first; q < end; q += 1) {
+            SWF_Edge piece = {
+                .kind = SWF_Edge_Kind_CURVE,
+                .control_x = twips_round(quadratics.control_x[q]),
+                .control_y = twips_round(quadratics.control_y[q]),
+                .x = twips_round(quadratics.x[q]),
+                .y = twips_round(quadratics.y[q]),
+            };
+            // NOTE(felix): the last piece ends exactly where the next edge starts
+            if (q + 1 == end) {
+                piece.x = edge->x;
+                piece.y = edge->y;
+            }
+            push(&curved, piece);
+        }
+    }
+    return curved;
+}
+
+// NOTE(felix): to the nearest multiple of `grid`, with halves up
+static i32 swf_quantize(i32 value, i32 grid) {
+    i64 shifted = (i64)value + grid / 2;
+    i64 steps = shifted / grid - (shifted % grid < 0);
+    i64 result = CLAMP(steps * grid, -(i64)SWF_TWIPS_MAX, (i64)SWF_TWIPS_MAX);
+    return (i32)result;
+}
+
+// NOTE(felix): snaps every point to a grid of `grid_twips`, so that deltas need fewer bits, and drops the edges that collapse onto their start.
+// A curve whose control point lands on one of its ends is a line. MoveTos left with nothing after them go in swf_edges_join_subpaths
+static void swf_edges_quantize(Array_SWF_Edge *edges, i32 grid_twips) {
+    if (grid_twips <= 1) return;
+
+    u64 kept = 0;
+    i32 x = 0, y = 0;
+    for_slice (SWF_Edge *, it, edges->slice) {
+        SWF_Edge edge = *it;
+        edge.x = swf_quantize(edge.x, grid_twips);
+        edge.y = swf_quantize(edge.y, grid_twips);
+        bool at_start = edge.x == x && edge.y == y;
+
+        if (edge.kind == SWF_Edge_Kind_LINE && at_start) continue;
+        if (edge.kind == SWF_Edge_Kind_CURVE) {
+            edge.control_x = swf_quantize(edge.control_x, grid_twips);
+            edge.control_y = swf_quantize(edge.control_y, grid_twips);
+            bool control_at_start = edge.control_x == x && edge.control_y == y;
+            bool control_at_end = edge.control_x == edge.x && edge.control_y == edge.y;
+            if (control_at_start || control_at_end) {
+                if (at_start) continue;
+                edge = (SWF_Edge){ .kind = SWF_Edge_Kind_LINE, .x = edge.x, .y = edge.y };
+            }
+        }
+
+        edges->data[kept] = edge;
+        kept += 1;
+        x = edge.x;
+        y = edge.y;
+    }
+    edges->count = kept;
+}
+
+static u64 swf_point_key(i32 x, i32 y) {
+    return ((u64)(u32)x << 32) | (u32)y;
+}
+
+// NOTE(felix): each subpath is followed by one starting where it ends, if there is one, so that it needs no MoveTo. A subpath is never
+// reversed to make it fit, since which side of an edge is filled depends on its direction. MoveTo coordinates are absolute rather than
+// relative to the pen, so the order of subpaths that can't be joined makes no difference to size. A MoveTo with nothing drawn after it is dropped
+static Array_SWF_Edge swf_edges_join_subpaths(Arena *arena, Array_SWF_Edge edges) {
+    Array_SWF_Subpath subpaths = { .arena = arena };
+    u32 drawn_count = 0;
+    for (u32 i = 0; i < edges.count; i += 1) {
+        if (edges.data[i].kind == SWF_Edge_Kind_MOVE || subpaths.count == 0) {
+            push(&subpaths, ((SWF_Subpath){ .begin = i, .next_same_start = UINT32_MAX }));
+        }
+        slice_get_last(subpaths)->end = i + 1;
+        drawn_count += edges.data[i].kind != SWF_Edge_Kind_MOVE;
+    }
+    if (drawn_count == 0) return edges;
+
+    // NOTE(felix): by start point, to the lowest subpath index starting there. The rest follow through `next_same_start`
+    Map_u32 first_from_start = {0};
+    map_make(arena, &first_from_start, subpaths.count);
+    for (u32 i = (u32)subpaths.count; i > 0; i -= 1) {
+        SWF_Subpath *subpath = &subpaths.data[i - 1];
+        SWF_Edge *move = &edges.data[subpath->begin];
+        if (move->kind != SWF_Edge_Kind_MOVE || subpath->end - subpath->begin == 1) continue;
+
+        u64 key = swf_point_key(move->x, move->y);
+        Map_Result found = map_get(&first_from_start, key, 0);
+        if (found.pointer != 0) subpath->next_same_start = *(u32 *)found.pointer;
+        u32 index = i - 1;
+        map_get(&first_from_start, key, &index);
+    }
+
+    Array_SWF_Edge joined = { .arena = arena };
+    reserve(&joined, edges.count);
+    for_slice (SWF_Subpath *, subpath, subpaths) {
+        if (subpath->used) continue;
+        subpath->used = true;
+        if (subpath->end - subpath->begin == 1 && edges.data[subpath->begin].kind == SWF_Edge_Kind_MOVE) continue;
+
+        push_slice(&joined, ((Slice_SWF_Edge){ .data = edges.data + subpath->begin, .count = subpath->end - subpath->begin }));
+        while (true) {
+            SWF_Edge *last = slice_get_last(joined);
+            Map_Result found = map_get(&first_from_start, swf_point_key(last->x, last->y), 0);
+            if (found.pointer == 0) break;
+
+            u32 *first = found.pointer;
+            while (*first != UINT32_MAX && subpaths.data[*first].used) *first = subpaths.data[*first].next_same_start;
+            if (*first == UINT32_MAX) break;
+
+            SWF_Subpath *next = &subpaths.data[*first];
+            next->used = true;
+            push_slice(&joined, ((Slice_SWF_Edge){ .data = edges.data + next->begin + 1, .count = next->end - next->begin - 1 }));
+        }
+    }
+    return joined;
+}
+
+// NOTE(felix): grows [min, max] to cover the quadratic from `from` through `control` to `to` on one axis
+static void swf_quadratic_extent(i32 from, i32 control, i32 to, i32 *min, i32 *max) {
+    *min = MIN(*min, to);
+    *max = MAX(*max, to);
+    if (MIN(from, to) <= control && control <= MAX(from, to)) return;
+
+    f64 extremum = ((f64)from * (f64)to - (f64)control * (f64)control) / ((f64)from - 2.0 * (f64)control + (f64)to);
+    *min = MIN(*min, (i32)floor(extremum));
+    *max = MAX(*max, (i32)ceil(extremum));
+}
+
+// NOTE(felix): `edges` are only read for paths
+static void swf_push_shapewithstyle(String_Builder *swf, SWF_Shape_With_Style shapes, SVG_Part part, Slice_SWF_Edge edges) {
+    // FILLSTYLEARRAY
+    push(swf, shapes.has_fill); // count
+    if (shapes.has_fill) { // FILLSTYLE
+        assert(shapes.fill_style.type == 0); // solid
+        push(swf, shapes.fill_style.type);
+        swf_push_color(swf, shapes.fill_style.color, shapes.tag_type);
+    }
+
+    // LINESTYLEARRAY
+    push(swf, shapes.has_line); // count
+    if (shapes.has_line) {
+        swf_write_u16(swf, shapes.line_style.width_twips);
+        swf_push_color(swf, shapes.line_style.color, shapes.tag_type);
+    }
+
+    push(swf, (u8)((shapes.has_fill << 4) | shapes.has_line)); // NumFillBits (high nibble), NumLineBits (low nibble)
+
+    SWF_Bit_Writer bw = { .swf = swf };
+
+    if (part.kind == SVG_Part_Kind_PATH) {
+        i32 last_x_tw = 0;
+        i32 last_y_tw = 0;
+        bool styles_selected = false;
+
+        for_slice (SWF_Edge *, edge, edges) {
+            if (edge->kind == SWF_Edge_Kind_MOVE) {
+                swf_bw_push_move(&bw, shapes, edge->x, edge->y, !styles_selected);
+                styles_selected = true;
+            } else if (edge->kind == SWF_Edge_Kind_LINE) {
+                swf_bw_push_line(&bw, edge->x - last_x_tw, edge->y - last_y_tw);
+            } else {
+                assert(edge->kind == SWF_Edge_Kind_CURVE);
+                swf_bw_push_curve(&bw, last_x_tw, last_y_tw, edge->control_x, edge->control_y, edge->x, edge->y);
+            }
+
+            last_x_tw = edge->x;
+            last_y_tw = edge->y;
+        }
+    } else if (part.kind == SVG_Part_Kind_RECT) {
+        i32 x0 = twips_from_svg_x(part.rect.position.x);
+        i32 y0 = twips_from_svg_y(part.rect.position.y);
+        i32 w  = twips_from_svg_dx(part.rect.size.x);
+        i32 h  = twips_from_svg_dy(part.rect.size.y);
+
+        swf_bw_push_move(&bw, shapes, x0, y0, true);
+
+        /* 4 StraightEdgeRecords (axis-aligned) */
+        swf_bw_push_line(&bw, +w, 0);
+        swf_bw_push_line(&bw, 0, +h);
+        swf_bw_push_line(&bw, -w, 0);
+        swf_bw_push_line(&bw, 0, -h);
+    } else {
+        assert(part.kind == SVG_Part_Kind_ELLIPSE);
+
+        i32 cx = twips_from_svg_x(part.ellipse.centre.x);
+        i32 cy = twips_from_svg_y(part.ellipse.centre.y);
+        i32 rx = twips_from_svg_dx(part.ellipse.radius.x);
+        i32 ry = twips_from_svg_dy(part.ellipse.radius.y);
+
+        assert(rx >= 0 && ry >= 0);
 
         /* Polyline approximation: 32 segments */
         u32 segments = 32;
@@ -617,28 +1633,7 @@ static void swf_push_shapewithstyle(String_Builder *swf, SWF_Shape_With_Style sh
         i32 px0 = cx + rx;
         i32 py0 = cy;
 
-        /* StyleChangeRecord: MoveTo + FillStyle0=1 + LineStyle=1 */
-        swf_bw_push_bit(&bw, 0);
-        swf_bw_push_bit(&bw, 0);
-        swf_bw_push_bit(&bw, 1);
-        swf_bw_push_bit(&bw, 0);
-        swf_bw_push_bit(&bw, 1);
-        swf_bw_push_bit(&bw, 1);
-
-        {
-            u32 mx = swf_sbits_width(px0);
-            u32 my = swf_sbits_width(py0);
-            u32 move_bits = (mx > my) ? mx : my;
-            if (move_bits < 1) move_bits = 1;
-            if (move_bits > 31) move_bits = 31;
-
-            swf_bw_push_ubits(&bw, move_bits, 5);
-            swf_bw_push_sbits(&bw, px0, move_bits);
-            swf_bw_push_sbits(&bw, py0, move_bits);
-        }
-
-        swf_bw_push_ubits(&bw, 1, 1);
-        swf_bw_push_ubits(&bw, 1, 1);
+        swf_bw_push_move(&bw, shapes, px0, py0, true);
 
         i32 prev_x = px0;
         i32 prev_y = py0;
@@ -648,24 +1643,7 @@ static void swf_push_shapewithstyle(String_Builder *swf, SWF_Shape_With_Style sh
             i32 x = cx + (i32)((f32)rx * cosf(t) + (rx >= 0 ? 0.5f : -0.5f));
             i32 y = cy + (i32)((f32)ry * sinf(t) + (ry >= 0 ? 0.5f : -0.5f));
 
-            i32 dx = x - prev_x;
-            i32 dy = y - prev_y;
-
-            swf_bw_push_bit(&bw, 1);
-            swf_bw_push_bit(&bw, 1);
-
-            {
-                u32 nx = swf_sbits_width(dx);
-                u32 ny = swf_sbits_width(dy);
-                u32 n = (nx > ny) ? nx : ny;
-                if (n < 2) n = 2;
-                if (n > 31) n = 31;
-
-                swf_bw_push_ubits(&bw, n - 2, 4);
-                swf_bw_push_bit(&bw, 1); /* GeneralLineFlag */
-                swf_bw_push_sbits(&bw, dx, n);
-                swf_bw_push_sbits(&bw, dy, n);
-            }
+            swf_bw_push_line(&bw, x - prev_x, y - prev_y);
 
             prev_x = x;
             prev_y = y;
@@ -678,509 +1656,1627 @@ static void swf_push_shapewithstyle(String_Builder *swf, SWF_Shape_With_Style sh
     swf_bw_byte_align(&bw);
 }
 
-static void swf_push_defineshape3(String_Builder *swf, u16 shape_id, SWF_Rect shape_bounds, SWF_Shape_With_Style shapes, SVG_Part part) {
-    assert(shape_id != 0);
+// NOTE(felix): a DefineShape body, of the version its styles need, after its character ID. The ID is assigned when the shape is defined, so that identical shapes share one
+static void swf_push_shape_body(String_Builder *swf, SWF_Rect shape_bounds, SWF_Shape_With_Style shapes, SVG_Part part, Slice_SWF_Edge edges) {
+    for (u64 i = 0; i < shape_bounds.count; i += 1) push(swf, shape_bounds.bytes[i]);
+    swf_push_shapewithstyle(swf, shapes, part, edges);
+}
 
-    u64 tag_start = swf->count;
-    swf_write_u16(swf, (u16)((SWF_Tag_Type_DEFINESHAPE3 << 6) | 0x3f));
-    u64 length_patch_at = swf->count;
-    swf_write_u32(swf, 0);
+static SWF_Shape_With_Style swf_shapes_from_style(SVG_Style style, i32 stroke_twips) {
+    SWF_Shape_With_Style shapes = {0};
+    shapes.fill_style.type = 0;
+    shapes.fill_style.color = svg_rgba_with_opacity(style.fill_rgba, style.fill_opacity * style.opacity);
+    shapes.has_fill = (shapes.fill_style.color & 0xff) != 0;
 
-    swf_write_u16(swf, shape_id);
-    for (u64 i = 0; i < sizeof shape_bounds.bytes; i += 1) push(swf, shape_bounds.bytes[i]);
-    swf_push_shapewithstyle(swf, shapes, part);
+    stroke_twips = CLAMP(stroke_twips, 0, 0xffff);
+    shapes.line_style.width_twips = (u16)stroke_twips;
+    shapes.line_style.color = svg_rgba_with_opacity(style.stroke_rgba, style.stroke_opacity * style.opacity);
+    shapes.has_line = (shapes.line_style.color & 0xff) != 0 && stroke_twips > 0;
 
-    u64 body_length = swf->count - (length_patch_at + 4);
-    assert(body_length <= 0xffffffffu);
-    u32 body_length_u32 = (u32)body_length;
-    swf->data[length_patch_at + 0] = (u8)(body_length_u32 >> 0);
-    swf->data[length_patch_at + 1] = (u8)(body_length_u32 >> 8);
-    swf->data[length_patch_at + 2] = (u8)(body_length_u32 >> 16);
-    swf->data[length_patch_at + 3] = (u8)(body_length_u32 >> 24);
+    bool opaque = (!shapes.has_fill || (shapes.fill_style.color & 0xff) == 0xff) && (!shapes.has_line || (shapes.line_style.color & 0xff) == 0xff);
+    shapes.tag_type = opaque ? SWF_Tag_Type_DEFINESHAPE : SWF_Tag_Type_DEFINESHAPE3;
 
-    assert((swf->count - tag_start) == (2 + 4 + body_length));
+    return shapes;
 }
 
-static void program(void) {
-    Arena arena = arena_init(8 * 1024 * 1024);
+static i32 swf_fixed_from_f32(f32 value) {
+    return (i32)floorf(value * 65536.f + 0.5f);
+}
 
-    Slice_String args = os_get_arguments(&arena);
-    if (args.count != 3) {
-        log_error("need two (2) arguments\nusage: %S <svg_input> <swf_output>", args.data[0]);
-        os_exit(1);
+// NOTE(felix): shapes are in twips relative to the viewBox, so the SVG transform is carried into that space
+static void swf_push_matrix(String_Builder *swf, M3 transform) {
+    V2 scale = g_viewbox.scale, min = g_viewbox.min;
+    i32 scale_x = swf_fixed_from_f32(transform.c[0][0]);
+    i32 scale_y = swf_fixed_from_f32(transform.c[1][1]);
+    i32 rotate_skew_0 = swf_fixed_from_f32(transform.c[0][1] * scale.y / scale.x);
+    i32 rotate_skew_1 = swf_fixed_from_f32(transform.c[1][0] * scale.x / scale.y);
+
+    V2 moved_min = {
+        .x = transform.c[0][0] * min.x + transform.c[1][0] * min.y + transform.c[2][0],
+        .y = transform.c[0][1] * min.x + transform.c[1][1] * min.y + transform.c[2][1],
+    };
+    i32 translate_x = twips_from_svg_dx(moved_min.x - min.x);
+    i32 translate_y = twips_from_svg_dy(moved_min.y - min.y);
+
+    SWF_Bit_Writer bw = { .swf = swf };
+
+    bool has_scale = scale_x != 65536 || scale_y != 65536;
+    swf_bw_push_bit(&bw, has_scale);
+    if (has_scale) {
+        u32 nbits = MAX(swf_sbits_width(scale_x), swf_sbits_width(scale_y));
+        swf_bw_push_ubits(&bw, nbits, 5);
+        swf_bw_push_sbits(&bw, scale_x, nbits);
+        swf_bw_push_sbits(&bw, scale_y, nbits);
+    }
+
+    bool has_rotate = rotate_skew_0 != 0 || rotate_skew_1 != 0;
+    swf_bw_push_bit(&bw, has_rotate);
+    if (has_rotate) {
+        u32 nbits = MAX(swf_sbits_width(rotate_skew_0), swf_sbits_width(rotate_skew_1));
+        swf_bw_push_ubits(&bw, nbits, 5);
+        swf_bw_push_sbits(&bw, rotate_skew_0, nbits);
+        swf_bw_push_sbits(&bw, rotate_skew_1, nbits);
     }
 
-    String svg_path = args.data[1];
-    String swf_path = args.data[2];
+    u32 translate_bits = (translate_x == 0 && translate_y == 0) ? 0 : MAX(swf_sbits_width(translate_x), swf_sbits_width(translate_y));
+    swf_bw_push_ubits(&bw, translate_bits, 5);
+    if (translate_bits != 0) {
+        swf_bw_push_sbits(&bw, translate_x, translate_bits);
+        swf_bw_push_sbits(&bw, translate_y, translate_bits);
+    }
 
-    String svg = os_read_entire_file(&arena, cstring_from_string(&arena, svg_path), 0);
-    if (svg.count == 0) {
-        log_error("failure reading file '%S'", svg_path);
-        os_exit(1);
+    swf_bw_byte_align(&bw);
+}
+
+// NOTE(felix): `move` modifies what's already at `depth`. Then a `character_id` of 0 keeps the character and only sets the matrix
+static void swf_push_placeobject2(String_Builder *swf, u16 depth, u16 character_id, M3 transform, bool move) {
+    u64 header_at = swf->count;
+    swf_write_u16(swf, 0); // filled below
+
+    u8 flags = 0;
+    flags |= (1u << 2); /* HasMatrix */
+    if (character_id != 0) flags |= (1u << 1); /* HasCharacter */
+    if (move) flags |= (1u << 0); /* Move */
+    push(swf, flags);
+
+    assert(depth != 0);
+    swf_write_u16(swf, depth);
+    if (character_id != 0) swf_write_u16(swf, character_id);
+    swf_push_matrix(swf, transform);
+
+    u64 body_length = swf->count - (header_at + 2);
+    assert(body_length < 0x3f);
+    u16 tag_code_and_length = (u16)((SWF_Tag_Type_PLACEOBJECT2 << 6) | body_length);
+    swf->data[header_at + 0] = (u8)tag_code_and_length;
+    swf->data[header_at + 1] = (u8)(tag_code_and_length >> 8);
+}
+
+static void swf_push_removeobject2(String_Builder *swf, u16 depth) {
+    swf_write_u16(swf, (u16)((SWF_Tag_Type_REMOVEOBJECT2 << 6) | 2));
+    swf_write_u16(swf, depth);
+}
+
+// NOTE(felix): in twips, as far as a shape's edges reach
+structdef(SWF_Bounds) { i32 min_x, max_x, min_y, max_y; };
+
+static SWF_Bounds swf_edges_bounds(Slice_SWF_Edge edges) {
+    SWF_Bounds bounds = { .min_x = 0x7fffffff, .max_x = -0x7fffffff, .min_y = 0x7fffffff, .max_y = -0x7fffffff };
+
+    i32 last_x_tw = 0;
+    i32 last_y_tw = 0;
+    for_slice (SWF_Edge *, edge, edges) {
+        if (edge->kind == SWF_Edge_Kind_CURVE) {
+            swf_quadratic_extent(last_x_tw, edge->control_x, edge->x, &bounds.min_x, &bounds.max_x);
+            swf_quadratic_extent(last_y_tw, edge->control_y, edge->y, &bounds.min_y, &bounds.max_y);
+        } else {
+            bounds.min_x = MIN(bounds.min_x, edge->x);
+            bounds.min_y = MIN(bounds.min_y, edge->y);
+            bounds.max_x = MAX(bounds.max_x, edge->x);
+            bounds.max_y = MAX(bounds.max_y, edge->y);
+        }
+        last_x_tw = edge->x;
+        last_y_tw = edge->y;
     }
 
-    Array_SVG_Part svg_parts = { .arena = &arena };
-
-    f32 svg_width = 0;
-    f32 svg_height = 0;
-
-    {
-        xml_Reader r = xml_reader((const char *)svg.data, svg.count);
-        xml_Value key = {0}, value = {0};
-        String key_string = {0}, value_string = {0};
-        while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-            if (key.type == xml_Type_TAG_OPEN && string_equals(key_string, string("svg"))) {
-                while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-                    if (key.type != xml_Type_ATTRIBUTE) continue;
-                    assert(value.type == xml_Type_ATTRIBUTE);
-
-                    f32 *parse_f32 = 0;
-                    if (string_equals(key_string, string("width"))) parse_f32 = &svg_width;
-                    else if (string_equals(key_string, string("height"))) parse_f32 = &svg_height;
-                    if (parse_f32 != 0) *parse_f32 = (f32)f64_from_string(value_string);
-
-                    if (string_equals(key_string, string("viewBox"))) {
-                        String v = value_string;
-
-                        u64 min_x_start = 0;
-                        u64 min_x_end = min_x_start;
-                        while (min_x_end < v.count && v.data[min_x_end] != ' ') min_x_end += 1;
-                        String min_x_string = string_range(v, min_x_start, min_x_end);
-                        g_viewbox.min.x = (f32)f64_from_string(min_x_string);
-
-                        u64 min_y_start = min_x_end + 1;
-                        u64 min_y_end = min_y_start;
-                        while (min_y_end < v.count && v.data[min_y_end] != ' ') min_y_end += 1;
-                        String min_y_string = string_range(v, min_y_start, min_y_end);
-                        g_viewbox.min.y = (f32)f64_from_string(min_y_string);
-
-                        u64 width_start = min_y_end + 1;
-                        u64 width_end = width_start;
-                        while (width_end < v.count && v.data[width_end] != ' ') width_end += 1;
-                        String width_string = string_range(v, width_start, width_end);
-                        g_viewbox.size.x = (f32)f64_from_string(width_string);
-
-                        u64 height_start = width_end + 1;
-                        u64 height_end = height_start;
-                        while (height_end < v.count && v.data[height_end] != ' ') height_end += 1;
-                        String height_string = string_range(v, height_start, height_end);
-                        g_viewbox.size.y = (f32)f64_from_string(height_string);
-
-                        assert(g_viewbox.size.x > 0);
-                        assert(g_viewbox.size.y > 0);
-                        g_viewbox.scale.x = svg_width / g_viewbox.size.x;
-                        g_viewbox.scale.y = svg_width / g_viewbox.size.y;
-                    }
+    assert(bounds.min_x <= bounds.max_x);
+    assert(bounds.min_y <= bounds.max_y);
+    return bounds;
+}
 
-                    bool done_here = svg_width != 0 && svg_height != 0 && g_viewbox.scale.x != 0;
-                    if (done_here) break;
-                }
-            }
+static bool swf_bounds_within(SWF_Bounds bounds, i32 size) {
+    return (i64)bounds.max_x - bounds.min_x < size && (i64)bounds.max_y - bounds.min_y < size;
+}
 
-            if (key.type != xml_Type_TAG_OPEN) continue;
+// NOTE(felix): drops the subpaths whose bounds fit in a square of `size` twips
+static void swf_edges_drop_small_subpaths(Array_SWF_Edge *edges, i32 size) {
+    u64 kept = 0;
+    for (u64 begin = 0; begin < edges->count;) {
+        u64 end = begin + 1;
+        while (end < edges->count && edges->data[end].kind != SWF_Edge_Kind_MOVE) end += 1;
+
+        Slice_SWF_Edge subpath = { .data = edges->data + begin, .count = end - begin };
+        bool small = subpath.data[0].kind == SWF_Edge_Kind_MOVE && swf_bounds_within(swf_edges_bounds(subpath), size);
+        if (!small) {
+            memmove(edges->data + kept, subpath.data, subpath.count * sizeof *subpath.data);
+            kept += subpath.count;
+        }
+        begin = end;
+    }
+    edges->count = kept;
+}
 
-            _Bool relevant = string_equals(key_string, string("path")) || string_equals(key_string, string("ellipse")) || string_equals(key_string, string("rect"));
-            if (!relevant) continue;
+// NOTE(felix): parts that are culled before encoding, by their style and size alone
+static SVG_Cull svg_part_cull(SVG_Part *part, SWF_Shape_With_Style shapes) {
+    if (part->style.display_none || part->style.visibility_hidden) return SVG_Cull_INVISIBLE;
+    if (!shapes.has_fill && !shapes.has_line) return SVG_Cull_INVISIBLE;
+    if (part->kind == SVG_Part_Kind_RECT && (part->rect.size.x <= 0 || part->rect.size.y <= 0)) return SVG_Cull_EMPTY;
+    if (part->kind == SVG_Part_Kind_ELLIPSE && (part->ellipse.radius.x <= 0 || part->ellipse.radius.y <= 0)) return SVG_Cull_EMPTY;
+    return SVG_Cull_NONE;
+}
 
-            SVG_Part part = {0};
-            u8 svg_kind = key_string.data[0];
+structdef(SWF_Encode_Options) {
+    i32 grid_twips; // NOTE(felix): path points are snapped to multiples of this
+    i32 min_feature_twips; // NOTE(felix): subpaths and parts that fit in a square this size, stroke included, are dropped. 0 for none
+    SWF_Bounds stage; // NOTE(felix): the movie's frame, which parts entirely outside of are culled
+};
 
-            while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-                if (key.type == xml_Type_ATTRIBUTE && string_equals(key_string, string("style"))) {
-                    svg_part_parse_style(&part, value_string);
-                    break;
-                }
+// NOTE(felix): how far past its edges a shape draws, since a stroke reaches half its width out
+static i32 swf_shapes_reach(SWF_Shape_With_Style shapes) {
+    return shapes.has_line ? shapes.line_style.width_twips / 2 + 1 : 0;
+}
+
+// NOTE(felix): `scratch_arena` holds a path's edges while it is encoded, and is replaced by a larger one if they don't fit. A part found to be entirely off the stage, or too small, is culled instead,
+// and nothing is written. Neither applies to a part some <use> places again, or one inside a group with a transform, since either may be moved or scaled.
+// Returns the bounds of what the part draws, stroke included
+static SWF_Bounds swf_push_part(String_Builder *swf, SVG_Part *part, SWF_Shape_With_Style shapes, SWF_Encode_Options options, Arena *scratch_arena) {
+    Scratch scratch = scratch_begin(scratch_arena);
+    Array_SWF_Edge edges = {0};
+    SWF_Bounds bounds = {0};
+
+    i32 reach = swf_shapes_reach(shapes);
+    bool moved = part->reused || part->transformed;
+    i32 min_size = moved ? 0 : options.min_feature_twips - 2 * reach;
+
+    switch (part->kind) {
+        case SVG_Part_Kind_PATH: {
+            f32 snap_twips = (f32)options.grid_twips / 2;
+            u64 edge_limit = swf_path_edge_room(scratch_arena, part->path.d.count);
+            u64 edge_count = 0;
+            edges = swf_edges_from_path(scratch_arena, part->path.d, snap_twips, edge_limit, &edge_count);
+
+            // NOTE(felix): a path with more curve pieces than the scratch has room for is read again with a larger scratch, which later parts keep.
+            // Arcs are counted before cubics, so a path with both may take a second try
+            while (edge_count > edge_limit) {
+                scratch_end(scratch);
+                arena_deinit(scratch_arena);
+                *scratch_arena = arena_init(swf_path_scratch_bytes(part->path.d.count, edge_count));
+                scratch = scratch_begin(scratch_arena);
+                edge_limit = edge_count;
+                edges = swf_edges_from_path(scratch_arena, part->path.d, snap_twips, edge_limit, &edge_count);
+            }
+            swf_edges_quantize(&edges, options.grid_twips);
+            edges = swf_edges_join_subpaths(scratch_arena, edges);
+
+            bool drawn = false;
+            for_slice (SWF_Edge *, edge, edges) drawn |= edge->kind != SWF_Edge_Kind_MOVE;
+            if (drawn && min_size > 0) swf_edges_drop_small_subpaths(&edges, min_size);
+            if (!drawn || edges.count == 0) {
+                part->cull = drawn ? SVG_Cull_SMALL : SVG_Cull_EMPTY;
+                scratch_end(scratch);
+                return bounds;
             }
+            bounds = swf_edges_bounds(edges.slice);
+        } break;
+        case SVG_Part_Kind_ELLIPSE: {
+            i32 cx = twips_from_svg_x(part->ellipse.centre.x);
+            i32 cy = twips_from_svg_y(part->ellipse.centre.y);
+            i32 rx = twips_from_svg_dx(part->ellipse.radius.x);
+            i32 ry = twips_from_svg_dy(part->ellipse.radius.y);
+            bounds = (SWF_Bounds){ .min_x = cx - rx, .max_x = cx + rx, .min_y = cy - ry, .max_y = cy + ry };
+        } break;
+        case SVG_Part_Kind_RECT: {
+            i32 x0 = twips_from_svg_x(part->rect.position.x);
+            i32 y0 = twips_from_svg_y(part->rect.position.y);
+            i32 x1 = x0 + twips_from_svg_dx(part->rect.size.x);
+            i32 y1 = y0 + twips_from_svg_dy(part->rect.size.y);
+            bounds = (SWF_Bounds){ .min_x = x0, .max_x = x1, .min_y = y0, .max_y = y1 };
+        } break;
+        default: unreachable;
+    }
 
-            switch (svg_kind) {
-                case 'p': {
-                    part.kind = SVG_Part_Kind_PATH;
+    SWF_Bounds stage = options.stage;
+    bool off_stage = bounds.max_x + reach < stage.min_x || bounds.min_x - reach > stage.max_x
+        || bounds.max_y + reach < stage.min_y || bounds.min_y - reach > stage.max_y;
 
-                    while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-                        if (key.type == xml_Type_TAG_CLOSE) break;
+    if (off_stage && !moved) part->cull = SVG_Cull_OFF_STAGE;
+    else if (min_size > 0 && swf_bounds_within(bounds, min_size)) part->cull = SVG_Cull_SMALL;
+    else {
+        SWF_Rect shape_bounds = swf_rect(bounds.min_x, bounds.max_x, bounds.min_y, bounds.max_y);
+        swf_push_shape_body(swf, shape_bounds, shapes, *part, edges.slice);
+    }
+    scratch_end(scratch);
 
-                        if (string_equals(key_string, string("d"))) {
-                            part.path.d = value_string;
-                        }
-                    }
+    return (SWF_Bounds){ .min_x = bounds.min_x - reach, .max_x = bounds.max_x + reach, .min_y = bounds.min_y - reach, .max_y = bounds.max_y + reach };
+}
 
-                    assert(part.path.d.count != 0);
-                } break;
-                case 'e': {
-                    part.kind = SVG_Part_Kind_ELLIPSE;
-                    String cx_string = {0}, cy_string = {0}, rx_string = {0}, ry_string = {0};
+static u64 hash_combine(u64 a, u64 b) {
+    u64 pair[2] = { a, b };
+    return hash_djb2(as_bytes(&pair));
+}
 
-                    while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-                        if (key.type == xml_Type_TAG_CLOSE) break;
+static u64 svg_part_hash(SVG_Part *part) {
+    u64 hash = hash_combine(part->kind, part->style_id);
+    switch (part->kind) {
+        case SVG_Part_Kind_PATH: return hash_combine(hash, hash_djb2(part->path.d));
+        case SVG_Part_Kind_ELLIPSE: return hash_combine(hash, hash_djb2(as_bytes(&part->ellipse)));
+        case SVG_Part_Kind_RECT: return hash_combine(hash, hash_djb2(as_bytes(&part->rect)));
+        default: unreachable;
+    }
+    return hash;
+}
 
-                        if (string_equals(key_string, string("cx"))) cx_string = value_string;
-                        else if (string_equals(key_string, string("cy"))) cy_string = value_string;
-                        else if (string_equals(key_string, string("rx"))) rx_string = value_string;
-                        else if (string_equals(key_string, string("ry"))) ry_string = value_string;
-                    }
+static bool svg_part_equals(SVG_Part *a, SVG_Part *b) {
+    if (a->kind != b->kind || a->style_id != b->style_id) return false;
+    switch (a->kind) {
+        case SVG_Part_Kind_PATH: return string_equals(a->path.d, b->path.d);
+        case SVG_Part_Kind_ELLIPSE: return string_equals(as_bytes(&a->ellipse), as_bytes(&b->ellipse));
+        case SVG_Part_Kind_RECT: return string_equals(as_bytes(&a->rect), as_bytes(&b->rect));
+        default: unreachable;
+    }
+    return false;
+}
 
-                    part.ellipse.centre.x = (f32)f64_from_string(cx_string);
-                    part.ellipse.centre.y = (f32)f64_from_string(cy_string);
-                    part.ellipse.radius.x = (f32)f64_from_string(rx_string);
-                    part.ellipse.radius.y = (f32)f64_from_string(ry_string);
-                } break;
-                case 'r': {
-                    part.kind = SVG_Part_Kind_RECT;
-                    String width_string = {0}, height_string = {0}, x_string = {0}, y_string = {0};
+typedef enum SVG_Node_Kind {
+    SVG_Node_Kind_PART,
+    SVG_Node_Kind_GROUP,
+    SVG_Node_Kind_USE,
+} SVG_Node_Kind;
+
+structdef(SVG_Node) { u32 index; SVG_Node_Kind kind; }; // NOTE(felix): a part, group, or <use>, in paint order
+
+typedef enum SVG_Sprite_State {
+    SVG_Sprite_State_NONE,
+    SVG_Sprite_State_PUSHING,
+    SVG_Sprite_State_PUSHED,
+} SVG_Sprite_State;
+
+structdef(SVG_Group) {
+    Array_SVG_Node children;
+    String id;
+    M3 transform;
+    bool hidden;
+    u32 canonical; // NOTE(felix): the first group identical to this one, which may be itself
+    SVG_Sprite_State sprite_state;
+    u16 character; // NOTE(felix): the sprite's ID, once it's defined
+};
 
-                    while (xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
-                        if (key.type == xml_Type_TAG_CLOSE) break;
+structdef(SVG_Use) {
+    String href;
+    M3 transform;
+    SVG_Node target;
+    bool resolved;
+};
 
-                        if (string_equals(key_string, string("width"))) width_string = value_string;
-                        else if (string_equals(key_string, string("height"))) height_string = value_string;
-                        else if (string_equals(key_string, string("x"))) x_string = value_string;
-                        else if (string_equals(key_string, string("y"))) y_string = value_string;
-                    }
+structdef(SVG_Tree) {
+    Array_SVG_Node root;
+    Array_SVG_Group groups; // in the order they open
+    Array_SVG_Use uses;
+};
+
+static u64 svg_node_hash(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node) {
+    u64 hash = 0;
+    switch (node.kind) {
+        case SVG_Node_Kind_PART: {
+            SVG_Part *part = &parts.data[node.index];
+            hash = hash_combine(svg_part_hash(part), hash_djb2(as_bytes(&part->transform)));
+        } break;
+        case SVG_Node_Kind_GROUP: {
+            SVG_Group *group = &tree->groups.data[node.index];
+            hash = hash_combine(hash_combine(group->canonical, group->hidden), hash_djb2(as_bytes(&group->transform)));
+        } break;
+        case SVG_Node_Kind_USE: {
+            SVG_Use *use = &tree->uses.data[node.index];
+            hash = hash_combine(hash_djb2(use->href), hash_djb2(as_bytes(&use->transform)));
+        } break;
+        default: unreachable;
+    }
+    return hash_combine(node.kind, hash);
+}
+
+static bool svg_node_equals(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node a, SVG_Node b) {
+    if (a.kind != b.kind) return false;
+    switch (a.kind) {
+        case SVG_Node_Kind_PART: {
+            SVG_Part *x = &parts.data[a.index], *y = &parts.data[b.index];
+            return svg_part_equals(x, y) && string_equals(as_bytes(&x->transform), as_bytes(&y->transform));
+        } break;
+        case SVG_Node_Kind_GROUP: {
+            SVG_Group *x = &tree->groups.data[a.index], *y = &tree->groups.data[b.index];
+            return x->canonical == y->canonical && x->hidden == y->hidden && string_equals(as_bytes(&x->transform), as_bytes(&y->transform));
+        } break;
+        case SVG_Node_Kind_USE: {
+            SVG_Use *x = &tree->uses.data[a.index], *y = &tree->uses.data[b.index];
+            return string_equals(x->href, y->href) && string_equals(as_bytes(&x->transform), as_bytes(&y->transform));
+        } break;
+        default: unreachable;
+    }
+    return false;
+}
+
+static bool svg_group_equals(SVG_Tree *tree, Slice_SVG_Part parts, u32 a, u32 b) {
+    Array_SVG_Node a_children = tree->groups.data[a].children, b_children = tree->groups.data[b].children;
+    if (a_children.count != b_children.count) return false;
+
+    for (u64 i = 0; i < a_children.count; i += 1) {
+        if (!svg_node_equals(tree, parts, a_children.data[i], b_children.data[i])) return false;
+    }
+    return true;
+}
 
-                    part.rect.position.x = (f32)f64_from_string(x_string);
-                    part.rect.position.y = (f32)f64_from_string(y_string);
-                    part.rect.size.x = (f32)f64_from_string(width_string);
-                    part.rect.size.y = (f32)f64_from_string(height_string);
+// NOTE(felix): the group's children are all closed by now, so nested groups are compared by their canonical group and their own transform.
+// A group's own transform isn't part of what it is, since identical groups share one sprite placed with each one's matrix
+static void svg_group_close(SVG_Tree *tree, Slice_SVG_Part parts, Map_u32 *canonical_from_hash, u32 g, bool mark_duplicates) {
+    SVG_Group *group = &tree->groups.data[g];
+
+    u64 hash = 5381;
+    for_slice (SVG_Node *, child, group->children) hash = hash_combine(hash, svg_node_hash(tree, parts, *child));
+
+    for (u64 key = hash;; key += 1) {
+        Map_Result found = map_get(canonical_from_hash, key, 0);
+        if (found.pointer == 0) {
+            map_get(canonical_from_hash, key, &g);
+            group->canonical = g;
+            return;
+        }
+
+        u32 candidate = *(u32 *)found.pointer;
+        if (!svg_group_equals(tree, parts, candidate, g)) continue;
+
+        group->canonical = candidate;
+        if (mark_duplicates) for (u64 i = 0; i < group->children.count; i += 1) {
+            SVG_Node child = group->children.data[i];
+            if (child.kind != SVG_Node_Kind_PART) continue;
+
+            // NOTE(felix): the canonical group's copy is drawn in this one's place too, so it's only culled by its bounds if they hold for both
+            SVG_Part *part = &parts.data[child.index];
+            part->duplicate = true;
+            parts.data[tree->groups.data[candidate].children.data[i].index].transformed |= part->transformed;
+        }
+        return;
+    }
+}
+
+static SVG_Tree svg_tree_build(Arena *arena, Slice_SVG_Part parts, Slice_SVG_Event events, bool mark_duplicates) {
+    SVG_Tree tree = { .root = { .arena = arena }, .groups = { .arena = arena }, .uses = { .arena = arena } };
+
+    u64 group_count = 0;
+    for_slice (SVG_Event *, event, events) group_count += event->kind == SVG_Event_Kind_GROUP_BEGIN;
+
+    Map_u32 canonical_from_hash = {0};
+    map_make(arena, &canonical_from_hash, MAX(group_count, 1));
+
+    Array_u32 open = { .arena = arena };
+    u64 transformed_open_count = 0; // NOTE(felix): of the open groups, those with a transform
+    u64 e = 0;
+    for (u64 i = 0; i <= parts.count; i += 1) {
+        for (; e < events.count && events.data[e].part_index == i; e += 1) {
+            SVG_Event *event = &events.data[e];
+            SVG_Node node = {0};
+            switch (event->kind) {
+                case SVG_Event_Kind_GROUP_BEGIN: {
+                    node = (SVG_Node){ .index = (u32)tree.groups.count, .kind = SVG_Node_Kind_GROUP };
+                    push(&tree.groups, ((SVG_Group){ .children = { .arena = arena }, .id = event->id, .transform = event->transform, .hidden = event->hidden }));
+                    transformed_open_count += !svg_transform_is_identity(event->transform);
+                } break;
+                case SVG_Event_Kind_GROUP_END: {
+                    if (open.count > 0) {
+                        open.count -= 1;
+                        transformed_open_count -= !svg_transform_is_identity(tree.groups.data[open.data[open.count]].transform);
+                        svg_group_close(&tree, parts, &canonical_from_hash, open.data[open.count], mark_duplicates);
+                    }
+                    continue;
+                } break;
+                case SVG_Event_Kind_USE: {
+                    node = (SVG_Node){ .index = (u32)tree.uses.count, .kind = SVG_Node_Kind_USE };
+                    push(&tree.uses, ((SVG_Use){ .href = event->href, .transform = event->transform }));
                 } break;
                 default: unreachable;
             }
 
-            push(&svg_parts, part);
+            Array_SVG_Node *container = open.count == 0 ? &tree.root : &tree.groups.data[*slice_get_last(open)].children;
+            push(container, node);
+            if (node.kind == SVG_Node_Kind_GROUP) push(&open, node.index);
         }
-        assert(r.error == xml_Error_OK);
+
+        if (i == parts.count) break;
+        parts.data[i].transformed = transformed_open_count > 0 || !svg_transform_is_identity(parts.data[i].transform);
+        Array_SVG_Node *container = open.count == 0 ? &tree.root : &tree.groups.data[*slice_get_last(open)].children;
+        push(container, ((SVG_Node){ .index = (u32)i, .kind = SVG_Node_Kind_PART }));
     }
 
-    String_Builder swf = { .arena = &arena };
-    string_builder_print(&swf, "%s",
-        "F" // uncompressed
-        "WS" // signature bytes
-        "\x06" // single-byte version (6)
-        "0000" // [u32] length of file in bytes, including this header (filled later)
-        "010203040" // [RECT] frame size, 9 bytes = 5 bits + 15 bits x 4 values, padded to the next full byte (filled later)
-    );
-    swf_write_u16(&swf, 0x0c00); // framerate
-    swf_write_u16(&swf, 1); // frame count
+    // NOTE(felix): the document's tags are checked for balance elsewhere
+    while (open.count > 0) {
+        open.count -= 1;
+        svg_group_close(&tree, parts, &canonical_from_hash, open.data[open.count], mark_duplicates);
+    }
+
+    return tree;
+}
+
+static String svg_node_id(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node) {
+    switch (node.kind) {
+        case SVG_Node_Kind_PART: return parts.data[node.index].id;
+        case SVG_Node_Kind_GROUP: return tree->groups.data[node.index].id;
+        default: return (String){0};
+    }
+}
 
-    u8 *frame_size_rect_in_header = &swf.data[8];
-    SWF_Rect frame_size = swf_rect(0, (i16)twips_from_pixels(svg_width), 0, (i16)twips_from_pixels(svg_height));
-    assert((frame_size.bytes[0] >> 3) != 0);
-    memcpy(frame_size_rect_in_header, frame_size.bytes, sizeof frame_size.bytes);
+// NOTE(felix): keys are the hash of the ID, stepping past any collision
+static bool svg_node_from_id(Map_SVG_Node *nodes, SVG_Tree *tree, Slice_SVG_Part parts, String id, SVG_Node *node) {
+    for (u64 key = hash_djb2(id);; key += 1) {
+        Map_Result found = map_get(nodes, key, 0);
+        if (found.pointer == 0) return false;
 
-    u16 next_shape_id = 1;
-    u16 next_depth = 1;
-    for (u64 i = 0; i < svg_parts.count; i += 1) {
-        SVG_Part *part = &svg_parts.data[i];
+        SVG_Node *candidate = found.pointer;
+        if (!string_equals(svg_node_id(tree, parts, *candidate), id)) continue;
 
-        switch (part->kind) {
-            case SVG_Part_Kind_PATH: {
-                assert(next_shape_id != 0);
-                assert(next_depth != 0);
+        *node = *candidate;
+        return true;
+    }
+}
 
-                u16 shape_id = next_shape_id++;
-                u16 depth = next_depth++;
+static void svg_node_put_id(Map_SVG_Node *nodes, SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node) {
+    String id = svg_node_id(tree, parts, node);
+    if (id.count == 0) return;
 
-                String d = part->path.d;
-                assert(d.count != 0);
+    for (u64 key = hash_djb2(id);; key += 1) {
+        Map_Result found = map_get(nodes, key, 0);
+        if (found.pointer == 0) {
+            map_get(nodes, key, &node);
+            return;
+        }
+        if (string_equals(svg_node_id(tree, parts, *(SVG_Node *)found.pointer), id)) return; // NOTE(felix): the first element with an ID keeps it
+    }
+}
 
-                u64 j = 0;
-                u8 cmd = 0;
+static void svg_node_mark_reused(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node) {
+    if (node.kind == SVG_Node_Kind_PART) parts.data[node.index].reused = true;
+    if (node.kind != SVG_Node_Kind_GROUP) return;
+    for_slice (SVG_Node *, child, tree->groups.data[node.index].children) svg_node_mark_reused(tree, parts, *child);
+}
 
-                f32 cur_x = 0, cur_y = 0;
-                f32 sub_x = 0, sub_y = 0;
-                bool have_point = false;
+static void svg_tree_resolve_uses(Arena *arena, SVG_Tree *tree, Slice_SVG_Part parts) {
+    if (tree->uses.count == 0) return;
 
-                i32 min_x_tw =  0x7fffffff;
-                i32 min_y_tw =  0x7fffffff;
-                i32 max_x_tw = -0x7fffffff;
-                i32 max_y_tw = -0x7fffffff;
+    Map_SVG_Node node_from_id = {0};
+    map_make(arena, &node_from_id, parts.count + tree->groups.count);
+    for (u64 i = 0; i < parts.count; i += 1) svg_node_put_id(&node_from_id, tree, parts, (SVG_Node){ .index = (u32)i, .kind = SVG_Node_Kind_PART });
+    for (u64 g = 0; g < tree->groups.count; g += 1) svg_node_put_id(&node_from_id, tree, parts, (SVG_Node){ .index = (u32)g, .kind = SVG_Node_Kind_GROUP });
 
-                while (j < d.count) {
-                    svg_path_skip(d, &j);
-                    if (j >= d.count) break;
+    for_slice (SVG_Use *, use, tree->uses) {
+        use->resolved = svg_node_from_id(&node_from_id, tree, parts, use->href, &use->target);
+        if (!use->resolved) continue;
 
-                    if (svg_path_is_cmd(d.data[j])) {
-                        cmd = d.data[j];
-                        j += 1;
-                    } else {
-                        assert(cmd != 0);
-                    }
+        // NOTE(felix): a part in a duplicate group is normally left to the canonical group's copy, but this one is placed by itself
+        if (use->target.kind == SVG_Node_Kind_PART) parts.data[use->target.index].duplicate = false;
+        svg_node_mark_reused(tree, parts, use->target);
+    }
+}
 
-                    if (cmd == 'M' || cmd == 'm') {
-                        f32 x = svg_path_read_f32(d, &j);
-                        f32 y = svg_path_read_f32(d, &j);
-
-                        if (cmd == 'm' && have_point) { x += cur_x; y += cur_y; }
-
-                        cur_x = x; cur_y = y;
-                        sub_x = x; sub_y = y;
-                        have_point = true;
-
-                        {
-                            i32 xt = twips_from_pixels(cur_x);
-                            i32 yt = twips_from_pixels(cur_y);
-                            if (xt < min_x_tw) min_x_tw = xt;
-                            if (yt < min_y_tw) min_y_tw = yt;
-                            if (xt > max_x_tw) max_x_tw = xt;
-                            if (yt > max_y_tw) max_y_tw = yt;
-                        }
-
-                        while (1) {
-                            svg_path_skip(d, &j);
-                            if (j >= d.count) break;
-                            if (svg_path_is_cmd(d.data[j])) break;
-
-                            f32 lx = svg_path_read_f32(d, &j);
-                            f32 ly = svg_path_read_f32(d, &j);
-                            if (cmd == 'm') { lx += cur_x; ly += cur_y; }
-
-                            cur_x = lx; cur_y = ly;
-
-                            {
-                                i32 xt = twips_from_pixels(cur_x);
-                                i32 yt = twips_from_pixels(cur_y);
-                                if (xt < min_x_tw) min_x_tw = xt;
-                                if (yt < min_y_tw) min_y_tw = yt;
-                                if (xt > max_x_tw) max_x_tw = xt;
-                                if (yt > max_y_tw) max_y_tw = yt;
-                            }
-                        }
-                    } else if (cmd == 'L' || cmd == 'l') {
-                        assert(have_point);
-
-                        while (1) {
-                            svg_path_skip(d, &j);
-                            if (j >= d.count) break;
-                            if (svg_path_is_cmd(d.data[j])) break;
-
-                            f32 x = svg_path_read_f32(d, &j);
-                            f32 y = svg_path_read_f32(d, &j);
-                            if (cmd == 'l') { x += cur_x; y += cur_y; }
-
-                            cur_x = x; cur_y = y;
-
-                            {
-                                i32 xt = twips_from_pixels(cur_x);
-                                i32 yt = twips_from_pixels(cur_y);
-                                if (xt < min_x_tw) min_x_tw = xt;
-                                if (yt < min_y_tw) min_y_tw = yt;
-                                if (xt > max_x_tw) max_x_tw = xt;
-                                if (yt > max_y_tw) max_y_tw = yt;
-                            }
-                        }
-                    } else if (cmd == 'C' || cmd == 'c') {
-                        assert(have_point);
-
-                        while (1) {
-                            svg_path_skip(d, &j);
-                            if (j >= d.count) break;
-                            if (svg_path_is_cmd(d.data[j])) break;
-
-                            f32 x1 = svg_path_read_f32(d, &j);
-                            f32 y1 = svg_path_read_f32(d, &j);
-                            f32 x2 = svg_path_read_f32(d, &j);
-                            f32 y2 = svg_path_read_f32(d, &j);
-                            f32 x3 = svg_path_read_f32(d, &j);
-                            f32 y3 = svg_path_read_f32(d, &j);
-
-                            if (cmd == 'c') {
-                                x1 += cur_x; y1 += cur_y;
-                                x2 += cur_x; y2 += cur_y;
-                                x3 += cur_x; y3 += cur_y;
-                            }
-
-                            f32 x0 = cur_x;
-                            f32 y0 = cur_y;
-
-                            u32 segments = 16;
-                            for (u32 s = 0; s <= segments; s += 1) {
-                                f32 t = (f32)s / (f32)segments;
-                                f32 it = 1.0f - t;
-
-                                f32 bx =
-                                    it*it*it*x0 +
-                                    3.0f*it*it*t*x1 +
-                                    3.0f*it*t*t*x2 +
-                                    t*t*t*x3;
-
-                                f32 by =
-                                    it*it*it*y0 +
-                                    3.0f*it*it*t*y1 +
-                                    3.0f*it*t*t*y2 +
-                                    t*t*t*y3;
-
-                                i32 xt = twips_from_pixels(bx);
-                                i32 yt = twips_from_pixels(by);
-
-                                if (xt < min_x_tw) min_x_tw = xt;
-                                if (yt < min_y_tw) min_y_tw = yt;
-                                if (xt > max_x_tw) max_x_tw = xt;
-                                if (yt > max_y_tw) max_y_tw = yt;
-                            }
-
-                            cur_x = x3;
-                            cur_y = y3;
-                        }
-                    } else if (cmd == 'Z' || cmd == 'z') {
-                        assert(have_point);
-
-                        {
-                            i32 xt = twips_from_pixels(sub_x);
-                            i32 yt = twips_from_pixels(sub_y);
-
-                            if (xt < min_x_tw) min_x_tw = xt;
-                            if (yt < min_y_tw) min_y_tw = yt;
-                            if (xt > max_x_tw) max_x_tw = xt;
-                            if (yt > max_y_tw) max_y_tw = yt;
-                        }
-
-                        cur_x = sub_x;
-                        cur_y = sub_y;
-                    } else {
-                        panic("unsupported SVG path command");
-                    }
-                }
+static M3 svg_node_transform(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node) {
+    switch (node.kind) {
+        case SVG_Node_Kind_PART: return parts.data[node.index].transform;
+        case SVG_Node_Kind_GROUP: return tree->groups.data[node.index].transform;
+        case SVG_Node_Kind_USE: return tree->uses.data[node.index].transform;
+        default: unreachable;
+    }
+    return m3_fill_diagonal(1);
+}
 
-                assert(min_x_tw <= max_x_tw);
-                assert(min_y_tw <= max_y_tw);
+// NOTE(felix): what placing `node` actually places, or false for nothing (a hidden group, or a <use> we couldn't resolve).
+// A <use> places its target with the target's own transform applied first, then the <use>'s
+static bool svg_node_placement(SVG_Tree *tree, Slice_SVG_Part parts, SVG_Node node, SVG_Node *target, M3 *transform) {
+    *target = node;
+    *transform = svg_node_transform(tree, parts, node);
+    switch (node.kind) {
+        case SVG_Node_Kind_PART: return true;
+        case SVG_Node_Kind_GROUP: return !tree->groups.data[node.index].hidden;
+        case SVG_Node_Kind_USE: {
+            SVG_Use *use = &tree->uses.data[node.index];
+            if (!use->resolved || use->target.kind == SVG_Node_Kind_USE) return false;
+            *target = use->target;
+            *transform = m3_mul_m3(use->transform, svg_node_transform(tree, parts, use->target));
+            return true;
+        } break;
+        default: unreachable;
+    }
+    return false;
+}
 
-                assert(min_x_tw >= -(1<<14) && min_x_tw < (1<<14));
-                assert(max_x_tw >= -(1<<14) && max_x_tw < (1<<14));
-                assert(min_y_tw >= -(1<<14) && min_y_tw < (1<<14));
-                assert(max_y_tw >= -(1<<14) && max_y_tw < (1<<14));
+structdef(SWF_Definition) {
+    SWF_Tag_Type type;
+    u16 id;
+    u64 body_offset, body_count; // NOTE(felix): into the output, after the ID
+};
 
-                SWF_Rect shape_bounds = swf_rect((i16)min_x_tw, (i16)max_x_tw, (i16)min_y_tw, (i16)max_y_tw);
+structdef(SWF_Placement) { u16 character_id; M3 transform; }; // NOTE(felix): character 0 for an empty depth
 
-                SWF_Shape_With_Style shapes = {0};
-                shapes.fill_style.type = 0;
-                shapes.fill_style.color = part->fill_rgba;
+// NOTE(felix): what carries over from one frame to the next
+structdef(SWF_Movie) {
+    String_Builder swf;
+    Map_SWF_Definition definitions;
+    u16 character_count;
+    Array_SWF_Placement display_list, next_display_list; // NOTE(felix): indexed by depth - 1
+    u8 version; // NOTE(felix): the lowest that has every tag written so far
+};
 
-                {
-                    i32 stroke_twips = twips_from_svg_dx(part->stroke_width);
-                    if (stroke_twips < 0) stroke_twips = 0;
-                    assert(stroke_twips <= 0xffff);
-                    shapes.line_style.width_twips = (u16)stroke_twips;
-                }
-                shapes.line_style.color = (part->fill_rgba != 0) ? part->fill_rgba : 0x000000ff;
+static void swf_movie_note_tag(SWF_Movie *movie, SWF_Tag_Type type) {
+    movie->version = MAX(movie->version, swf_tag_version(type));
+}
 
-                swf_push_defineshape3(&swf, shape_id, shape_bounds, shapes, *part);
+static SWF_Movie swf_movie_make(Arena *arena) {
+    SWF_Movie movie = {
+        .swf = { .arena = arena },
+        .display_list = { .arena = arena },
+        .next_display_list = { .arena = arena },
+    };
+    map_make(arena, &movie.definitions, 0xffff);
+    return movie;
+}
 
-                {
-                    u16 body_length = 1 + 2 + 2 + 1;
-                    u16 tag_code_and_length = (u16)((SWF_Tag_Type_PLACEOBJECT2 << 6) | body_length);
-                    swf_write_u16(&swf, tag_code_and_length);
+// NOTE(felix): writes a definition tag and returns its new character ID, unless a definition with identical bytes was written before,
+// in this frame or an earlier one, in which case that one's ID is returned instead
+static u16 swf_movie_define(SWF_Movie *movie, SWF_Tag_Type type, String body) {
+    u64 key = hash_combine(type, hash_djb2(body));
+    for (;; key += 1) {
+        Map_Result found = map_get(&movie->definitions, key, 0);
+        if (found.pointer == 0) break;
+
+        SWF_Definition *definition = found.pointer;
+        String defined_body = { .data = movie->swf.data + definition->body_offset, .count = definition->body_count };
+        if (definition->type == type && string_equals(defined_body, body)) return definition->id;
+    }
 
-                    u8 flags = 0;
-                    flags |= (1u << 2);
-                    flags |= (1u << 1);
-                    push(&swf, flags);
+    if (movie->character_count == 0xffff) {
+        log_error("more than 65535 distinct shapes and sprites, but SWF can't give more than that an ID");
+        os_exit(1);
+    }
+    movie->character_count += 1;
+    swf_movie_note_tag(movie, type);
 
-                    swf_write_u16(&swf, depth);
-                    swf_write_u16(&swf, shape_id);
-                    push(&swf, 0);
-                }
-            } break;
-            case SVG_Part_Kind_ELLIPSE: {
-                assert(next_shape_id != 0);
-                assert(next_depth != 0);
-
-                u16 shape_id = next_shape_id++;
-                u16 depth = next_depth++;
-
-                i32 cx = twips_from_pixels(part->ellipse.centre.x);
-                i32 cy = twips_from_pixels(part->ellipse.centre.y);
-                i32 rx = twips_from_pixels(part->ellipse.radius.x);
-                i32 ry = twips_from_pixels(part->ellipse.radius.y);
-
-                i32 x0 = cx - rx;
-                i32 y0 = cy - ry;
-                i32 x1 = cx + rx;
-                i32 y1 = cy + ry;
-
-                assert(x0 >= -(1<<14) && x0 < (1<<14));
-                assert(x1 >= -(1<<14) && x1 < (1<<14));
-                assert(y0 >= -(1<<14) && y0 < (1<<14));
-                assert(y1 >= -(1<<14) && y1 < (1<<14));
-
-                SWF_Rect shape_bounds = swf_rect((i16)x0, (i16)x1, (i16)y0, (i16)y1);
-
-                SWF_Shape_With_Style shapes = {0};
-                shapes.fill_style.type = 0;
-                shapes.fill_style.color = part->fill_rgba;
-
-                {
-                    i32 stroke_twips = twips_from_pixels(part->stroke_width);
-                    if (stroke_twips < 0) stroke_twips = 0;
-                    assert(stroke_twips <= 0xffff);
-                    shapes.line_style.width_twips = (u16)stroke_twips;
-                }
-                shapes.line_style.color = (part->fill_rgba != 0) ? part->fill_rgba : 0x000000ff;
+    String_Builder *swf = &movie->swf;
+    u64 body_length = 2 + body.count;
+    assert(body_length <= 0xffffffffu);
+    swf_write_u16(swf, (u16)((type << 6) | 0x3f));
+    swf_write_u32(swf, (u32)body_length);
+    swf_write_u16(swf, movie->character_count);
 
-                swf_push_defineshape3(&swf, shape_id, shape_bounds, shapes, *part);
+    SWF_Definition definition = { .type = type, .id = movie->character_count, .body_offset = swf->count, .body_count = body.count };
+    push_slice(swf, body);
+    map_get(&movie->definitions, key, &definition);
 
-                {
-                    u16 body_length = 1 + 2 + 2 + 1;
-                    u16 tag_code_and_length = (u16)((SWF_Tag_Type_PLACEOBJECT2 << 6) | body_length);
-                    swf_write_u16(&swf, tag_code_and_length);
+    return definition.id;
+}
 
-                    u8 flags = 0;
-                    flags |= (1u << 2);
-                    flags |= (1u << 1);
-                    push(&swf, flags);
+// NOTE(felix): depths are placed in increasing order each frame, and only what changed since the last frame is written
+static void swf_movie_place(SWF_Movie *movie, u16 character_id, M3 transform) {
+    u16 depth = (u16)(movie->next_display_list.count + 1);
+    SWF_Placement placement = { .character_id = character_id, .transform = transform };
+    push(&movie->next_display_list, placement);
 
-                    swf_write_u16(&swf, depth);
-                    swf_write_u16(&swf, shape_id);
-                    push(&swf, 0);
-                }
+    SWF_Placement before = {0};
+    if (depth <= movie->display_list.count) before = movie->display_list.data[depth - 1];
+
+    if (character_id == 0) {
+        if (before.character_id != 0) {
+            swf_movie_note_tag(movie, SWF_Tag_Type_REMOVEOBJECT2);
+            swf_push_removeobject2(&movie->swf, depth);
+        }
+        return;
+    }
+
+    swf_movie_note_tag(movie, SWF_Tag_Type_PLACEOBJECT2);
+    if (before.character_id == character_id) {
+        bool moved = !string_equals(as_bytes(&before.transform), as_bytes(&transform));
+        if (moved) swf_push_placeobject2(&movie->swf, depth, 0, transform, true);
+    } else swf_push_placeobject2(&movie->swf, depth, character_id, transform, before.character_id != 0);
+}
+
+static void swf_movie_show_frame(SWF_Movie *movie) {
+    for (u64 i = movie->next_display_list.count; i < movie->display_list.count; i += 1) {
+        if (movie->display_list.data[i].character_id == 0) continue;
+        swf_movie_note_tag(movie, SWF_Tag_Type_REMOVEOBJECT2);
+        swf_push_removeobject2(&movie->swf, (u16)(i + 1));
+    }
+    swf_movie_note_tag(movie, SWF_Tag_Type_SHOWFRAME);
+    swf_write_u16(&movie->swf, (u16)((SWF_Tag_Type_SHOWFRAME << 6) | 0));
+
+    Array_SWF_Placement shown = movie->next_display_list;
+    movie->next_display_list = movie->display_list;
+    movie->next_display_list.count = 0;
+    movie->display_list = shown;
+}
+
+// NOTE(felix): one document's worth of state while it's written as a frame
+structdef(SWF_Frame) {
+    SWF_Movie *movie;
+    Arena *arena;
+    SVG_Tree *tree;
+    Slice_SVG_Part parts;
+    SWF_Shape_With_Style *styles; // by style ID
+    String *part_bodies; // NOTE(felix): what swf_push_part encoded for each part
+    u16 *part_characters; // NOTE(felix): 0 until the part is first needed
+};
+
+// NOTE(felix): shapes and sprites are only defined once something places them, just before their first placement.
+// Returns 0 for a culled part, and for a group that places itself through a <use>, which can't be defined
+static u16 swf_frame_character(SWF_Frame *frame, SVG_Node target) {
+    if (target.kind == SVG_Node_Kind_PART) {
+        if (frame->parts.data[target.index].cull != SVG_Cull_NONE) return 0;
+        u16 *character = &frame->part_characters[target.index];
+        SWF_Tag_Type type = frame->styles[frame->parts.data[target.index].style_id].tag_type;
+        if (*character == 0) *character = swf_movie_define(frame->movie, type, frame->part_bodies[target.index]);
+        return *character;
+    }
+    assert(target.kind == SVG_Node_Kind_GROUP);
+
+    SVG_Tree *tree = frame->tree;
+    SVG_Group *group = &tree->groups.data[tree->groups.data[target.index].canonical];
+    if (group->sprite_state == SVG_Sprite_State_PUSHED) return group->character;
+    if (group->sprite_state == SVG_Sprite_State_PUSHING) return 0;
+    group->sprite_state = SVG_Sprite_State_PUSHING;
+
+    // NOTE(felix): a sprite can only place characters defined before it, and it can't contain their definitions
+    SVG_Node child_target = {0};
+    M3 transform = {0};
+    for_slice (SVG_Node *, child, group->children) {
+        if (svg_node_placement(tree, frame->parts, *child, &child_target, &transform)) swf_frame_character(frame, child_target);
+    }
+
+    String_Builder body = { .arena = frame->arena };
+    swf_write_u16(&body, 1); // frame count
+    for (u64 i = 0; i < group->children.count; i += 1) {
+        if (!svg_node_placement(tree, frame->parts, group->children.data[i], &child_target, &transform)) continue;
+        u16 character_id = swf_frame_character(frame, child_target);
+        if (character_id != 0) swf_push_placeobject2(&body, (u16)(i + 1), character_id, transform, false);
+    }
+    swf_write_u16(&body, (u16)((SWF_Tag_Type_SHOWFRAME << 6) | 0));
+    swf_write_u16(&body, (u16)((SWF_Tag_Type_END << 6) | 0));
+
+    group->character = swf_movie_define(frame->movie, SWF_Tag_Type_DEFINESPRITE, body.string);
+    group->sprite_state = SVG_Sprite_State_PUSHED;
+    return group->character;
+}
+
+// NOTE(felix): with `flatten`, groups put their children straight onto this display list instead of being placed as sprites, with the groups' transforms composed into theirs.
+// `parent` is what the groups around `nodes` compose to
+static void swf_frame_place(SWF_Frame *frame, Slice_SVG_Node nodes, bool flatten, M3 parent) {
+    for_slice (SVG_Node *, node, nodes) {
+        if (flatten && node->kind == SVG_Node_Kind_GROUP) {
+            SVG_Group *group = &frame->tree->groups.data[node->index];
+            if (!group->hidden) swf_frame_place(frame, group->children.slice, flatten, m3_mul_m3(parent, group->transform));
+            continue;
+        }
+
+        SVG_Node target = {0};
+        M3 transform = {0};
+        u16 character_id = 0;
+        if (svg_node_placement(frame->tree, frame->parts, *node, &target, &transform)) character_id = swf_frame_character(frame, target);
+        swf_movie_place(frame->movie, character_id, m3_mul_m3(parent, transform));
+    }
+}
+
+#define SWF_COVERAGE_CELLS 64
+#define SWF_COVERAGE_RECTS_MAX 64
+
+// NOTE(felix): a conservative record of what opaque rects cover: the rects themselves (the first few), and a grid over the stage where a cell
+// is only covered once a single rect covers all of it
+structdef(SWF_Coverage) {
+    Array_SWF_Bounds rects;
+    SWF_Bounds stage;
+    i32 cell_width, cell_height;
+    bool *cells; // NOTE(felix): SWF_COVERAGE_CELLS by SWF_COVERAGE_CELLS, row by row
+};
+
+static SWF_Coverage swf_coverage_make(Arena *arena, SWF_Bounds stage) {
+    SWF_Coverage coverage = {
+        .rects = { .arena = arena },
+        .stage = stage,
+        .cell_width = MAX((stage.max_x - stage.min_x + SWF_COVERAGE_CELLS - 1) / SWF_COVERAGE_CELLS, 1),
+        .cell_height = MAX((stage.max_y - stage.min_y + SWF_COVERAGE_CELLS - 1) / SWF_COVERAGE_CELLS, 1),
+        .cells = arena_make(arena, SWF_COVERAGE_CELLS * SWF_COVERAGE_CELLS, bool),
+    };
+    memset(coverage.cells, 0, SWF_COVERAGE_CELLS * SWF_COVERAGE_CELLS * sizeof *coverage.cells);
+    return coverage;
+}
+
+static SWF_Bounds swf_bounds_clip(SWF_Bounds bounds, SWF_Bounds to) {
+    return (SWF_Bounds){
+        .min_x = CLAMP(bounds.min_x, to.min_x, to.max_x), .max_x = CLAMP(bounds.max_x, to.min_x, to.max_x),
+        .min_y = CLAMP(bounds.min_y, to.min_y, to.max_y), .max_y = CLAMP(bounds.max_y, to.min_y, to.max_y),
+    };
+}
+
+// NOTE(felix): the cells that `bounds`, already clipped to the stage, touches
+static SWF_Bounds swf_coverage_cell_range(SWF_Coverage *coverage, SWF_Bounds bounds) {
+    return (SWF_Bounds){
+        .min_x = MIN((bounds.min_x - coverage->stage.min_x) / coverage->cell_width, SWF_COVERAGE_CELLS - 1),
+        .max_x = MIN((bounds.max_x - coverage->stage.min_x) / coverage->cell_width, SWF_COVERAGE_CELLS - 1),
+        .min_y = MIN((bounds.min_y - coverage->stage.min_y) / coverage->cell_height, SWF_COVERAGE_CELLS - 1),
+        .max_y = MIN((bounds.max_y - coverage->stage.min_y) / coverage->cell_height, SWF_COVERAGE_CELLS - 1),
+    };
+}
+
+static void swf_coverage_add(SWF_Coverage *coverage, SWF_Bounds rect) {
+    SWF_Bounds stage = coverage->stage;
+
+    // NOTE(felix): an edge inside the stage is antialiased, so a little of what's under its outermost pixel still shows through
+    if (rect.min_x > stage.min_x) rect.min_x += 20;
+    if (rect.max_x < stage.max_x) rect.max_x -= 20;
+    if (rect.min_y > stage.min_y) rect.min_y += 20;
+    if (rect.max_y < stage.max_y) rect.max_y -= 20;
+    rect = swf_bounds_clip(rect, stage);
+    if (rect.min_x >= rect.max_x || rect.min_y >= rect.max_y) return;
+
+    if (coverage->rects.count < SWF_COVERAGE_RECTS_MAX) push(&coverage->rects, rect);
+
+    SWF_Bounds cells = swf_coverage_cell_range(coverage, rect);
+    for (i32 y = cells.min_y; y <= cells.max_y; y += 1) {
+        i32 cell_min_y = stage.min_y + y * coverage->cell_height;
+        i32 cell_max_y = MIN(cell_min_y + coverage->cell_height, stage.max_y);
+        if (cell_min_y < rect.min_y || cell_max_y > rect.max_y) continue;
+
+        for (i32 x = cells.min_x; x <= cells.max_x; x += 1) {
+            i32 cell_min_x = stage.min_x + x * coverage->cell_width;
+            i32 cell_max_x = MIN(cell_min_x + coverage->cell_width, stage.max_x);
+            if (cell_min_x < rect.min_x || cell_max_x > rect.max_x) continue;
+            coverage->cells[y * SWF_COVERAGE_CELLS + x] = true;
+        }
+    }
+}
+
+// NOTE(felix): whether everything in `bounds` that's on the stage is covered
+static bool swf_coverage_covers(SWF_Coverage *coverage, SWF_Bounds bounds) {
+    bounds = swf_bounds_clip(bounds, coverage->stage);
+
+    for_slice (SWF_Bounds *, rect, coverage->rects) {
+        bool inside = rect->min_x <= bounds.min_x && bounds.max_x <= rect->max_x && rect->min_y <= bounds.min_y && bounds.max_y <= rect->max_y;
+        if (inside) return true;
+    }
+
+    SWF_Bounds cells = swf_coverage_cell_range(coverage, bounds);
+    for (i32 y = cells.min_y; y <= cells.max_y; y += 1) {
+        for (i32 x = cells.min_x; x <= cells.max_x; x += 1) {
+            if (!coverage->cells[y * SWF_COVERAGE_CELLS + x]) return false;
+        }
+    }
+    return true;
+}
+
+// NOTE(felix): a group whose sprite is also placed for an identical group, where what covers one copy may not cover the other
+static bool *svg_tree_shared_groups(Arena *arena, SVG_Tree *tree) {
+    bool *shared = arena_make(arena, MAX(tree->groups.count, 1), bool);
+    memset(shared, 0, MAX(tree->groups.count, 1) * sizeof *shared);
+    for (u64 g = 0; g < tree->groups.count; g += 1) {
+        u32 canonical = tree->groups.data[g].canonical;
+        if (canonical == g) continue;
+        shared[g] = true;
+        shared[canonical] = true;
+    }
+    return shared;
+}
+
+// NOTE(felix): the rect around `bounds` once placed with `transform`, carried into twips as swf_push_matrix does, then grown by `margin` twips.
+// The matrix is rounded when it's written, so a negative margin, for a rect that's certainly inside, only holds for a transform that neither rotates nor skews
+static SWF_Bounds swf_bounds_transform(SWF_Bounds bounds, M3 transform, i32 margin) {
+    V2 min = g_viewbox.min;
+    f64 twips_x = (f64)g_viewbox.scale.x * 20, twips_y = (f64)g_viewbox.scale.y * 20;
+    i32 corner_x[2] = { bounds.min_x, bounds.max_x }, corner_y[2] = { bounds.min_y, bounds.max_y };
+
+    f64 low_x = INFINITY, high_x = -INFINITY, low_y = INFINITY, high_y = -INFINITY;
+    for (u64 i = 0; i < 4; i += 1) {
+        f64 x = min.x + corner_x[i & 1] / twips_x, y = min.y + corner_y[i >> 1] / twips_y;
+        f64 moved_x = (transform.c[0][0] * x + transform.c[1][0] * y + transform.c[2][0] - min.x) * twips_x;
+        f64 moved_y = (transform.c[0][1] * x + transform.c[1][1] * y + transform.c[2][1] - min.y) * twips_y;
+        low_x = MIN(low_x, moved_x); high_x = MAX(high_x, moved_x);
+        low_y = MIN(low_y, moved_y); high_y = MAX(high_y, moved_y);
+    }
+
+    f64 limit = 0x7fffffff;
+    return (SWF_Bounds){
+        .min_x = (i32)CLAMP(floor(low_x) - margin, -limit, limit),
+        .max_x = (i32)CLAMP(ceil(high_x) + margin, -limit, limit),
+        .min_y = (i32)CLAMP(floor(low_y) - margin, -limit, limit),
+        .max_y = (i32)CLAMP(ceil(high_y) + margin, -limit, limit),
+    };
+}
+
+structdef(SWF_Occlusion) {
+    SVG_Tree *tree;
+    Slice_SVG_Part parts;
+    SWF_Shape_With_Style *styles; // by style ID
+    SWF_Bounds *part_bounds; // NOTE(felix): what swf_push_part found each part draws
+    bool *shared_groups; // NOTE(felix): by group, with --sprites
+    SWF_Coverage coverage;
+};
+
+// NOTE(felix): walks `nodes` as drawn, in reverse paint order, culling parts that opaque rects painted after them cover.
+// <use>s are passed over, so what they draw never covers anything, and the parts they place again are never culled.
+// `transform` is what the groups around `nodes` compose to, and each part's own transform is applied before it. A rect that's rotated or skewed is no longer a rect, so it covers nothing
+static void svg_nodes_occlude(SWF_Occlusion *occlusion, Slice_SVG_Node nodes, bool shared, M3 transform) {
+    for (u64 i = nodes.count; i > 0; i -= 1) {
+        SVG_Node node = nodes.data[i - 1];
+        if (node.kind == SVG_Node_Kind_GROUP) {
+            SVG_Group *group = &occlusion->tree->groups.data[node.index];
+            bool group_shared = shared || (occlusion->shared_groups != 0 && occlusion->shared_groups[node.index]);
+            if (!group->hidden) svg_nodes_occlude(occlusion, group->children.slice, group_shared, m3_mul_m3(transform, group->transform));
+            continue;
+        }
+        if (node.kind != SVG_Node_Kind_PART) continue;
+
+        // NOTE(felix): a duplicate's bounds weren't found, since it wasn't encoded
+        SVG_Part *part = &occlusion->parts.data[node.index];
+        if (part->duplicate || part->cull != SVG_Cull_NONE) continue;
+
+        SWF_Bounds bounds = occlusion->part_bounds[node.index];
+        M3 placed = m3_mul_m3(transform, part->transform);
+        bool moved = !svg_transform_is_identity(placed);
+        SWF_Bounds drawn = moved ? swf_bounds_transform(bounds, placed, 1) : bounds;
+        if (!part->reused && !shared && swf_coverage_covers(&occlusion->coverage, drawn)) {
+            part->cull = SVG_Cull_OCCLUDED;
+            continue;
+        }
+
+        SWF_Shape_With_Style shapes = occlusion->styles[part->style_id];
+        bool opaque_rect = part->kind == SVG_Part_Kind_RECT && shapes.has_fill && (shapes.fill_style.color & 0xff) == 0xff;
+        bool axis_aligned = placed.c[0][1] == 0 && placed.c[1][0] == 0;
+        if (opaque_rect && axis_aligned) {
+            i32 reach = swf_shapes_reach(shapes);
+            SWF_Bounds fill = { .min_x = bounds.min_x + reach, .max_x = bounds.max_x - reach, .min_y = bounds.min_y + reach, .max_y = bounds.max_y - reach };
+            if (fill.min_x >= fill.max_x || fill.min_y >= fill.max_y) continue;
+            swf_coverage_add(&occlusion->coverage, moved ? swf_bounds_transform(fill, placed, -1) : fill);
+        }
+    }
+}
+
+typedef void Job_Function(void *work, Arena *arena);
+
+structdef(Job_Helper) {
+    Job_Function *function;
+    void *work;
+    Arena arena;
+    Os_Thread thread;
+    u32 trace_slot;
+};
+
+static void job_helper_entry(void *helper_) {
+    Job_Helper *helper = helper_;
+    trace_attach_this_thread(helper->trace_slot);
+    helper->function(helper->work, &helper->arena);
+}
+
+// NOTE(felix): runs `function` on the calling thread with `arena`, and on up to `thread_count - 1` more threads with arenas of their own, returning once all have finished.
+// `function` should claim its work with atomics until there is none left. Free the helpers with jobs_end() once nothing allocated on their arenas is needed.
+// Call it from the main thread only, since the helpers take the trace slots after it
+static Slice_Job_Helper jobs_run(Arena *arena, u64 thread_count, u64 helper_arena_bytes, Job_Function *function, void *work) {
+    Slice_Job_Helper helpers = { .count = thread_count - (thread_count != 0) };
+    helpers.data = arena_make(arena, helpers.count, Job_Helper);
+
+    for (u64 i = 0; i < helpers.count; i += 1) {
+        Job_Helper *helper = &helpers.data[i];
+        *helper = (Job_Helper){ .function = function, .work = work, .arena = arena_init(helper_arena_bytes), .trace_slot = (u32)(1 + i) };
+        helper->thread = os_thread_start(job_helper_entry, helper);
+    }
+
+    function(work, arena);
+
+    for_slice (Job_Helper *, helper, helpers) os_thread_join(helper->thread);
+    return helpers;
+}
+
+static void jobs_end(Slice_Job_Helper helpers) {
+    for_slice (Job_Helper *, helper, helpers) arena_deinit(&helper->arena);
+}
+
+// NOTE(felix): parses every <path>, <ellipse>, and <rect> from where `r` is until its end
+static void svg_parse_elements(xml_Reader *r, Array_SVG_Part *parts, Array_SVG_Event *events, Map_SVG_Style_Cached *style_cache) {
+    xml_Value key = {0}, value = {0};
+    String key_string = {0}, value_string = {0};
+    bool have_key = xml_read_with_strings(r, &key, &value, &key_string, &value_string);
+    while (have_key) {
+        SVG_Name tag = svg_name_classify(key_string);
+        if (key.type != xml_Type_TAG_OPEN) {
+            bool group_end = tag == SVG_Name_G || tag == SVG_Name_DEFS || tag == SVG_Name_SYMBOL;
+            if (key.type == xml_Type_TAG_CLOSE && group_end) {
+                push(events, ((SVG_Event){ .part_index = parts->count, .kind = SVG_Event_Kind_GROUP_END }));
+            }
+            have_key = xml_read_with_strings(r, &key, &value, &key_string, &value_string);
+            continue;
+        }
+
+        // NOTE(felix): the attributes end at the first key that isn't one, which is left for the next iteration
+        String attributes[SVG_Name_COUNT] = {0};
+        while ((have_key = xml_read_with_strings(r, &key, &value, &key_string, &value_string)) && key.type == xml_Type_ATTRIBUTE) {
+            attributes[svg_name_classify(key_string)] = value_string;
+        }
+
+        SVG_Part part = { .id = attributes[SVG_Name_ID], .transform = svg_transform_parse(attributes[SVG_Name_TRANSFORM]) };
+        switch (tag) {
+            case SVG_Name_G: case SVG_Name_DEFS: case SVG_Name_SYMBOL: {
+                SVG_Event group = {
+                    .part_index = parts->count,
+                    .kind = SVG_Event_Kind_GROUP_BEGIN,
+                    .hidden = tag != SVG_Name_G,
+                    .id = part.id,
+                    .transform = svg_transform_parse(attributes[SVG_Name_TRANSFORM]),
+                };
+                push(events, group);
+            } continue;
+            case SVG_Name_USE: {
+                String href = attributes[SVG_Name_HREF].count != 0 ? attributes[SVG_Name_HREF] : attributes[SVG_Name_XLINK_HREF];
+                if (href.count < 2 || href.data[0] != '#') continue;
+
+                // NOTE(felix): x and y translate after the transform attribute
+                M3 transform = svg_transform_parse(attributes[SVG_Name_TRANSFORM]);
+                M3 offset = m3_fill_diagonal(1);
+                offset.c[2][0] = svg_number_from_string(attributes[SVG_Name_X]);
+                offset.c[2][1] = svg_number_from_string(attributes[SVG_Name_Y]);
+
+                SVG_Event use = {
+                    .part_index = parts->count,
+                    .kind = SVG_Event_Kind_USE,
+                    .href = string_range(href, 1, href.count),
+                    .transform = m3_mul_m3(transform, offset),
+                };
+                push(events, use);
+            } continue;
+            case SVG_Name_PATH: part.kind = SVG_Part_Kind_PATH; break;
+            case SVG_Name_ELLIPSE: part.kind = SVG_Part_Kind_ELLIPSE; break;
+            case SVG_Name_RECT: part.kind = SVG_Part_Kind_RECT; break;
+            default: continue;
+        }
+
+        // NOTE(felix): the style attribute takes precedence over presentation attributes
+        part.style = svg_style_initial;
+        bool has_presentation_attributes = false;
+        for (SVG_Name name = SVG_Name_OTHER + 1; name < SVG_Name_COUNT; name += 1) {
+            if (attributes[name].count == 0) continue;
+            has_presentation_attributes |= svg_style_apply(&part.style, name, attributes[name]);
+        }
+
+        String css = attributes[SVG_Name_STYLE];
+        if (has_presentation_attributes || css.count == 0) svg_style_parse(&part.style, css);
+        else part.style = svg_style_parse_cached(style_cache, css);
+
+        switch (part.kind) {
+            case SVG_Part_Kind_PATH: {
+                part.path.d = attributes[SVG_Name_D];
+                assert(part.path.d.count != 0);
+            } break;
+            case SVG_Part_Kind_ELLIPSE: {
+                part.ellipse.centre.x = (f32)f64_from_string(attributes[SVG_Name_CX]);
+                part.ellipse.centre.y = (f32)f64_from_string(attributes[SVG_Name_CY]);
+                part.ellipse.radius.x = (f32)f64_from_string(attributes[SVG_Name_RX]);
+                part.ellipse.radius.y = (f32)f64_from_string(attributes[SVG_Name_RY]);
             } break;
             case SVG_Part_Kind_RECT: {
-                assert(next_shape_id != 0);
-                assert(next_depth != 0);
+                part.rect.position.x = (f32)f64_from_string(attributes[SVG_Name_X]);
+                part.rect.position.y = (f32)f64_from_string(attributes[SVG_Name_Y]);
+                part.rect.size.x = (f32)f64_from_string(attributes[SVG_Name_WIDTH]);
+                part.rect.size.y = (f32)f64_from_string(attributes[SVG_Name_HEIGHT]);
+            } break;
+            default: unreachable;
+        }
 
-                u16 shape_id = next_shape_id++;
-                u16 depth = next_depth++;
+        push(parts, part);
+    }
+}
 
-                i32 x0 = twips_from_pixels(part->rect.position.x);
-                i32 y0 = twips_from_pixels(part->rect.position.y);
-                i32 x1 = x0 + twips_from_pixels(part->rect.size.x);
-                i32 y1 = y0 + twips_from_pixels(part->rect.size.y);
+// NOTE(felix): a structural pre-scan of the document, in the spirit of simdjson's stage 1.
+// First, every '<', '>', and '"' is found a register's width at a time. Then only those positions are walked, tracking whether they are inside a tag or a quote.
+// Quotes are skipped wherever they appear, exactly as xml_read skips them, so that every chunk boundary is one the sequential reader would also pass through
+typedef void Scan_Structurals_Function(String svg, u64 begin, Array_u32 *structurals);
+
+// NOTE(felix): `mask` has a bit set for each structural character in the block starting at `at`, with each byte taking up `1 << bits_per_byte_shift` bits
+static force_inline void svg_push_structurals(Array_u32 *structurals, u64 at, u64 mask, u64 bits_per_byte_shift) {
+    while (mask != 0) {
+        u64 lowest = mask & (~mask + 1);
+        push(structurals, (u32)(at + (count_trailing_zeroes(lowest) >> bits_per_byte_shift)));
+        mask ^= lowest;
+    }
+}
 
-                SWF_Rect shape_bounds = swf_rect((i16)x0, (i16)x1, (i16)y0, (i16)y1);
+static u64 swar_mask_bytes_equal(u64 word, u8 byte) {
+    u64 x = word ^ (0x0101010101010101ull * byte);
+    u64 low_bits_nonzero = (x & 0x7f7f7f7f7f7f7f7full) + 0x7f7f7f7f7f7f7f7full;
+    return ~(low_bits_nonzero | x | 0x7f7f7f7f7f7f7f7full); // the high bit of each byte equal to `byte`
+}
 
-                SWF_Shape_With_Style shapes = {0};
-                shapes.fill_style.type = 0;
-                shapes.fill_style.color = part->fill_rgba;
+static void svg_scan_structurals_scalar(String svg, u64 begin, Array_u32 *structurals) {
+    u64 i = begin;
+    for (; i + 8 <= svg.count; i += 8) {
+        // NOTE(felix): byte order in the mask assumes little-endian, as are all our targets
+        u64 word = 0;
+        memcpy(&word, svg.data + i, 8);
 
-                {
-                    i32 stroke_twips = twips_from_pixels(part->stroke_width);
-                    if (stroke_twips < 0) stroke_twips = 0;
-                    assert(stroke_twips <= 0xffff);
-                    shapes.line_style.width_twips = (u16)stroke_twips;
-                }
-                shapes.line_style.color = (part->fill_rgba != 0) ? part->fill_rgba : 0x000000ff;
+        u64 mask = swar_mask_bytes_equal(word, '<') | swar_mask_bytes_equal(word, '>') | swar_mask_bytes_equal(word, '"');
+        svg_push_structurals(structurals, i, mask, 3);
+    }
+
+    for (; i < svg.count; i += 1) {
+        u8 c = svg.data[i];
+        if (c == '<' || c == '>' || c == '"') push(structurals, (u32)i);
+    }
+}
+
+#if ARCH_X64
+static target_sse2 void svg_scan_structurals_sse2(String svg, u64 begin, Array_u32 *structurals) {
+    __m128i open = _mm_set1_epi8('<'), close = _mm_set1_epi8('>'), quote = _mm_set1_epi8('"');
+
+    u64 i = begin;
+    for (; i + 16 <= svg.count; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(svg.data + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, open), _mm_cmpeq_epi8(bytes, close)), _mm_cmpeq_epi8(bytes, quote));
+        svg_push_structurals(structurals, i, (u32)_mm_movemask_epi8(hits), 0);
+    }
+
+    svg_scan_structurals_scalar(svg, i, structurals);
+}
+
+static target_avx2 void svg_scan_structurals_avx2(String svg, u64 begin, Array_u32 *structurals) {
+    __m256i open = _mm256_set1_epi8('<'), close = _mm256_set1_epi8('>'), quote = _mm256_set1_epi8('"');
+
+    u64 i = begin;
+    for (; i + 32 <= svg.count; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(svg.data + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, open), _mm256_cmpeq_epi8(bytes, close)), _mm256_cmpeq_epi8(bytes, quote));
+        svg_push_structurals(structurals, i, (u32)_mm256_movemask_epi8(hits), 0);
+    }
+
+    svg_scan_structurals_scalar(svg, i, structurals);
+}
+
+static target_avx512 void svg_scan_structurals_avx512(String svg, u64 begin, Array_u32 *structurals) {
+    __m512i open = _mm512_set1_epi8('<'), close = _mm512_set1_epi8('>'), quote = _mm512_set1_epi8('"');
+
+    u64 i = begin;
+    for (; i + 64 <= svg.count; i += 64) {
+        __m512i bytes = _mm512_loadu_si512((const void *)(svg.data + i));
+        u64 mask = _mm512_cmpeq_epi8_mask(bytes, open) | _mm512_cmpeq_epi8_mask(bytes, close) | _mm512_cmpeq_epi8_mask(bytes, quote);
+        svg_push_structurals(structurals, i, mask, 0);
+    }
+
+    svg_scan_structurals_scalar(svg, i, structurals);
+}
+#endif // ARCH_X64
+
+static Scan_Structurals_Function *svg_scan_structurals_variants[Cpu_Isa_COUNT] = {
+    [Cpu_Isa_SCALAR] = svg_scan_structurals_scalar,
+    #if ARCH_X64
+        [Cpu_Isa_SSE2] = svg_scan_structurals_sse2,
+        [Cpu_Isa_AVX2] = svg_scan_structurals_avx2,
+        [Cpu_Isa_AVX512] = svg_scan_structurals_avx512,
+    #endif
+};
+
+static bool svg_tag_is(String after_angle_bracket, String name) {
+    if (!string_starts_with(after_angle_bracket, name)) return false;
+    if (after_angle_bracket.count == name.count) return false;
+    u8 c = after_angle_bracket.data[name.count];
+    return ascii_is_whitespace(c) || c == '/' || c == '>';
+}
+
+// NOTE(felix): the byte offset of the '<' of every <path>, <ellipse>, and <rect> from `begin` on, in document order
+static Array_u32 svg_scan_element_starts(Arena *arena, String svg, u64 begin) {
+    ensure(svg.count <= UINT32_MAX);
+
+    Array_u32 structurals = { .arena = arena };
+    reserve(&structurals, svg.count / 16);
+    svg_scan_structurals_variants[g_isa](svg, begin, &structurals);
+
+    Array_u32 starts = { .arena = arena };
+    bool in_tag = false, in_quote = false;
+    for_slice (u32 *, at, structurals) {
+        u8 c = svg.data[*at];
+
+        if (in_quote) {
+            in_quote = c != '"';
+            continue;
+        }
+
+        if (c == '"') in_quote = true;
+        else if (in_tag) in_tag = c != '>';
+        else if (c == '<') {
+            // NOTE(felix): comments, CDATA, and processing instructions count as tags too, since that is how xml_read skips them
+            in_tag = true;
+            String rest = string_range(svg, *at + 1, svg.count);
+            bool relevant = svg_tag_is(rest, string("path")) || svg_tag_is(rest, string("ellipse")) || svg_tag_is(rest, string("rect"));
+            if (relevant) push(&starts, *at);
+        }
+    }
+
+    return starts;
+}
+
+#define PARSE_PARALLEL_MIN_BYTES (256 * 1024)
+
+structdef(Parse_Chunk) {
+    u64 begin, end;
+    Array_SVG_Part parts;
+    Array_SVG_Event events;
+    int depth;
+    xml_Error error;
+};
+
+structdef(Parse_Work) {
+    String svg;
+    Parse_Chunk *chunks;
+    u64 chunk_count;
+    u64 next_chunk; // claimed atomically
+};
+
+static void parse_chunks(void *work_, Arena *arena) {
+    Parse_Work *work = work_;
+
+    Map_SVG_Style_Cached style_cache = {0};
+    map_make(arena, &style_cache, SVG_STYLE_CACHE_CAPACITY);
+
+    while (true) {
+        u64 c = atomic_add_u64(&work->next_chunk, 1);
+        if (c >= work->chunk_count) break;
+
+        Parse_Chunk *chunk = &work->chunks[c];
+        chunk->parts.arena = arena;
+        chunk->events.arena = arena;
+
+        trace_scope("parse chunk", (i64)c) {
+            xml_Reader r = xml_reader((const char *)work->svg.data + chunk->begin, chunk->end - chunk->begin);
+            svg_parse_elements(&r, &chunk->parts, &chunk->events, &style_cache);
+            chunk->depth = r.depth;
+            chunk->error = r.error;
+        }
+    }
+}
+
+#define ENCODE_PARTS_PER_CHUNK 32
+
+structdef(Encode_Work) {
+    Slice_SVG_Part parts;
+    SWF_Shape_With_Style *styles; // by style ID
+    SWF_Encode_Options options;
+    String_Builder *chunks; // one per ENCODE_PARTS_PER_CHUNK parts, in document order
+    String *part_bodies; // into the chunks; empty for duplicates
+    SWF_Bounds *part_bounds; // NOTE(felix): what each encoded part draws, for occlusion
+    u64 scratch_bytes; // for each thread, enough to read the longest path, though not always for all the curves it becomes
+    u64 chunk_count;
+    u64 next_chunk; // claimed atomically
+};
 
-                swf_push_defineshape3(&swf, shape_id, shape_bounds, shapes, *part);
+static void encode_chunks(void *work_, Arena *arena) {
+    Encode_Work *work = work_;
+    Arena scratch_arena = arena_init(work->scratch_bytes);
+    while (true) {
+        u64 chunk = atomic_add_u64(&work->next_chunk, 1);
+        if (chunk >= work->chunk_count) break;
+
+        String_Builder *out = &work->chunks[chunk];
+        out->arena = arena;
+
+        u64 begin = chunk * ENCODE_PARTS_PER_CHUNK;
+        u64 end = MIN(begin + ENCODE_PARTS_PER_CHUNK, work->parts.count);
+        u64 body_offsets[ENCODE_PARTS_PER_CHUNK + 1] = {0};
+        for (u64 i = begin; i < end; i += 1) {
+            SVG_Part *part = &work->parts.data[i];
+            body_offsets[i - begin] = out->count;
+            if (part->duplicate || part->cull != SVG_Cull_NONE) continue;
+
+            trace_scope("part", (i64)i) work->part_bounds[i] = swf_push_part(out, part, work->styles[part->style_id], work->options, &scratch_arena);
+        }
+        body_offsets[end - begin] = out->count;
 
-                {
-                    u16 body_length = 1 + 2 + 2 + 1;
-                    u16 tag_code_and_length = (u16)((SWF_Tag_Type_PLACEOBJECT2 << 6) | body_length);
-                    swf_write_u16(&swf, tag_code_and_length);
+        // NOTE(felix): only now, since the chunk may have moved while it grew
+        for (u64 i = begin; i < end; i += 1) {
+            work->part_bodies[i] = string_range(out->string, body_offsets[i - begin], body_offsets[i - begin + 1]);
+        }
+    }
+    arena_deinit(&scratch_arena);
+}
+
+structdef(SVG_Document) {
+    Array_SVG_Part parts;
+    Array_SVG_Event events;
+    f32 width, height;
+};
+
+// NOTE(felix): sets g_viewbox from the document's <svg> element
+static SVG_Document svg_parse_document(Arena *arena, String svg, String svg_path, u64 job_count) {
+    SVG_Document document = { .parts = { .arena = arena }, .events = { .arena = arena } };
+    memset(&g_viewbox, 0, sizeof g_viewbox);
+
+    xml_Reader r = xml_reader((const char *)svg.data, svg.count);
+    xml_Value key = {0}, value = {0};
+    String key_string = {0}, value_string = {0};
+
+    bool found_svg = false;
+    while (!found_svg && xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) {
+        found_svg = key.type == xml_Type_TAG_OPEN && svg_name_classify(key_string) == SVG_Name_SVG;
+    }
+    if (!found_svg) {
+        log_error("no <svg> element in '%S'", svg_path);
+        os_exit(1);
+    }
+
+    // NOTE(felix): read the attributes of <svg>, stopping at the end of its start tag without consuming what comes after
+    while (true) {
+        while (r.c < r.end && ascii_is_whitespace((u8)*r.c)) r.c += 1;
+        if (r.c == r.end || *r.c == '>' || *r.c == '/') break;
+        if (!xml_read_with_strings(&r, &key, &value, &key_string, &value_string)) break;
+        if (key.type != xml_Type_ATTRIBUTE) continue;
+        assert(value.type == xml_Type_ATTRIBUTE);
+
+        SVG_Name name = svg_name_classify(key_string);
+
+        f32 *parse_f32 = 0;
+        if (name == SVG_Name_WIDTH) parse_f32 = &document.width;
+        else if (name == SVG_Name_HEIGHT) parse_f32 = &document.height;
+        if (parse_f32 != 0) *parse_f32 = (f32)f64_from_string(value_string);
+
+        if (name == SVG_Name_VIEWBOX) {
+            u64 at = 0;
+            i64 viewbox[4] = {0};
+            for (u64 i = 0; i < 4; i += 1) viewbox[i] = svg_path_read_fixed(value_string, &at);
+            assert(viewbox[2] > 0);
+            assert(viewbox[3] > 0);
+
+            g_viewbox.fixed_min_x = viewbox[0];
+            g_viewbox.fixed_min_y = viewbox[1];
+            g_viewbox.min.x = (f32)((f64)viewbox[0] / SVG_FIXED_ONE);
+            g_viewbox.min.y = (f32)((f64)viewbox[1] / SVG_FIXED_ONE);
+            g_viewbox.size.x = (f32)((f64)viewbox[2] / SVG_FIXED_ONE);
+            g_viewbox.size.y = (f32)((f64)viewbox[3] / SVG_FIXED_ONE);
+        }
+    }
+
+    // NOTE(felix): done once all attributes are read, since width and height may come after viewBox. Either one missing takes the viewBox's
+    if (g_viewbox.size.x > 0) {
+        if (document.width == 0) document.width = g_viewbox.size.x;
+        if (document.height == 0) document.height = g_viewbox.size.y;
+        g_viewbox.scale.x = document.width / g_viewbox.size.x;
+        g_viewbox.scale.y = document.height / g_viewbox.size.y;
+    } else g_viewbox.scale = (V2){ .x = 1, .y = 1 };
+    g_viewbox.twips_per_fixed_x = (f64)g_viewbox.scale.x * 20 / SVG_FIXED_ONE;
+    g_viewbox.twips_per_fixed_y = (f64)g_viewbox.scale.y * 20 / SVG_FIXED_ONE;
+
+    bool self_closing = r.c < r.end && *r.c == '/';
+    if (self_closing) xml_read(&r, &key, &value);
+
+    if (r.error != xml_Error_OK) {
+        log_error("malformed XML in '%S'", svg_path);
+        os_exit(1);
+    }
 
-                    u8 flags = 0;
-                    flags |= (1u << 2); /* HasMatrix */
-                    flags |= (1u << 1); /* HasCharacter */
-                    push(&swf, flags);
+    u64 body_begin = self_closing ? svg.count : (u64)(r.c - r.data);
+    u64 body_bytes = svg.count - body_begin;
 
-                    swf_write_u16(&swf, depth);
-                    swf_write_u16(&swf, shape_id);
-                    push(&swf, 0); /* empty MATRIX */
+    Array_u64 cuts = { .arena = arena };
+    push(&cuts, body_begin);
+
+    bool parallel = job_count > 1 && body_bytes >= PARSE_PARALLEL_MIN_BYTES;
+    if (parallel) {
+        Array_u32 element_starts = {0};
+        trace_scope("prescan", -1) element_starts = svg_scan_element_starts(arena, svg, body_begin);
+
+        // NOTE(felix): a few chunks per thread, so that a thread that gets unlucky with its chunks doesn't hold everyone up
+        u64 target_chunk_count = MIN(job_count * 4, element_starts.count);
+        u64 target_chunk_bytes = body_bytes / MAX(target_chunk_count, 1);
+        for_slice (u32 *, start, element_starts) {
+            if (*start - *slice_get_last(cuts) >= target_chunk_bytes) push(&cuts, *start);
+        }
+    }
+    push(&cuts, svg.count);
+
+    Parse_Work work = { .svg = svg, .chunk_count = cuts.count - 1 };
+    work.chunks = arena_make(arena, work.chunk_count, Parse_Chunk);
+    for (u64 c = 0; c < work.chunk_count; c += 1) {
+        work.chunks[c] = (Parse_Chunk){ .begin = cuts.data[c], .end = cuts.data[c + 1] };
+    }
+
+    Slice_Job_Helper helpers = jobs_run(arena, MIN(job_count, work.chunk_count), MAX(16 * 1024 * 1024, 4 * svg.count), parse_chunks, &work);
+
+    // NOTE(felix): chunks don't begin or end on balanced tags, so only the document as a whole can be checked for that
+    xml_Error error = xml_Error_OK;
+    i64 depth = r.depth;
+    for (u64 c = 0; c < work.chunk_count; c += 1) {
+        Parse_Chunk *chunk = &work.chunks[c];
+        for_slice (SVG_Event *, event, chunk->events) {
+            SVG_Event moved = *event;
+            moved.part_index += document.parts.count;
+            push(&document.events, moved);
+        }
+        push_slice(&document.parts, chunk->parts); // parts only point into `svg`, so they outlive the helpers' arenas
+        depth += chunk->depth;
+        bool depth_error = chunk->error == xml_Error_UNCLOSED_TAGS || chunk->error == xml_Error_TOO_MANY_CLOSING_TAGS;
+        if (!depth_error && chunk->error != xml_Error_OK) error = chunk->error;
+    }
+    if (error == xml_Error_OK && depth > 0) error = xml_Error_UNCLOSED_TAGS;
+    if (error == xml_Error_OK && depth < 0) error = xml_Error_TOO_MANY_CLOSING_TAGS;
+
+    jobs_end(helpers);
+
+    if (error != xml_Error_OK) {
+        log_error("malformed XML in '%S'", svg_path);
+        os_exit(1);
+    }
+
+    return document;
+}
+
+#define USAGE "usage: %S [--trace <trace_json_output>] [--jobs <thread_count>] [--force-isa scalar|sse2|avx2|avx512] [--sprites] [--grid <pixels>] [--render-size <width>x<height>] [--min-feature-size <pixels>] [--stats] <svg_input | -> [more_svg_inputs...] <swf_output | ->"
+
+static void program(void) {
+    Arena arena = arena_init(64 * 1024 * 1024);
+
+    Slice_String args = os_get_arguments(&arena);
+
+    String trace_path = {0};
+    bool sprites = false;
+    bool print_stats = false;
+    i32 grid_twips = 1;
+    f64 min_feature_pixels = 0;
+    u64 render_width = 0, render_height = 0; // NOTE(felix): 0 for the document's own size
+    u64 job_count = os_cpu_count();
+    g_isa = cpu_isa_supported();
+    svg_name_check();
+    Array_String positional = { .arena = &arena };
+    for (u64 i = 1; i < args.count; i += 1) {
+        String argument = args.data[i];
+        if (string_equals(argument, string("--trace"))) {
+            if (i + 1 == args.count) {
+                log_error("--trace needs a path\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+            trace_path = args.data[i];
+        } else if (string_equals(argument, string("--jobs"))) {
+            if (i + 1 == args.count) {
+                log_error("--jobs needs a thread count\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+            job_count = int_from_string_base(args.data[i], 10);
+            if (job_count == 0) {
+                log_error("--jobs needs a thread count of at least 1, not '%S'", args.data[i]);
+                os_exit(1);
+            }
+        } else if (string_equals(argument, string("--force-isa"))) {
+            if (i + 1 == args.count) {
+                log_error("--force-isa needs an instruction set\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+
+            Cpu_Isa forced = Cpu_Isa_COUNT;
+            for (Cpu_Isa isa = 0; isa < Cpu_Isa_COUNT; isa += 1) {
+                if (string_equals(args.data[i], string_from_cstring(cpu_isa_names[isa]))) forced = isa;
+            }
+            if (forced == Cpu_Isa_COUNT) {
+                log_error("unknown instruction set '%S'\n" USAGE, args.data[i], args.data[0]);
+                os_exit(1);
+            }
+
+            Cpu_Isa supported = cpu_isa_supported();
+            if (forced > supported) {
+                log_error("this CPU doesn't support %s; the widest it supports is %s", cpu_isa_names[forced], cpu_isa_names[supported]);
+                os_exit(1);
+            }
+            g_isa = forced;
+        } else if (string_equals(argument, string("--sprites"))) {
+            sprites = true;
+        } else if (string_equals(argument, string("--stats"))) {
+            print_stats = true;
+        } else if (string_equals(argument, string("--grid"))) {
+            if (i + 1 == args.count) {
+                log_error("--grid needs a size in pixels\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+            f64 grid_pixels = f64_from_string(args.data[i]);
+            if (!(grid_pixels * 20 >= 0.5 && grid_pixels * 20 < (f64)SWF_TWIPS_MAX)) {
+                log_error("--grid needs a size of at least 1/20 pixel, not '%S'", args.data[i]);
+                os_exit(1);
+            }
+            grid_twips = twips_round(grid_pixels * 20);
+        } else if (string_equals(argument, string("--min-feature-size"))) {
+            if (i + 1 == args.count) {
+                log_error("--min-feature-size needs a size in pixels\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+            min_feature_pixels = f64_from_string(args.data[i]);
+            if (!(min_feature_pixels > 0 && min_feature_pixels < 1e6)) {
+                log_error("--min-feature-size needs a positive size, not '%S'", args.data[i]);
+                os_exit(1);
+            }
+        } else if (string_equals(argument, string("--render-size"))) {
+            if (i + 1 == args.count) {
+                log_error("--render-size needs a size like 64x64\n" USAGE, args.data[0]);
+                os_exit(1);
+            }
+            i += 1;
+            String size = args.data[i];
+            u64 x = 0;
+            while (x < size.count && size.data[x] != 'x') x += 1;
+            if (x < size.count) {
+                render_width = int_from_string_base(string_range(size, 0, x), 10);
+                render_height = int_from_string_base(string_range(size, x + 1, size.count), 10);
+            }
+            if (render_width == 0 || render_height == 0 || render_width > 0xffff || render_height > 0xffff) {
+                log_error("--render-size needs a size like 64x64, not '%S'", size);
+                os_exit(1);
+            }
+        } else push(&positional, argument);
+    }
+
+    if (positional.count < 2) {
+        log_error("need at least two (2) arguments\n" USAGE, args.data[0]);
+        os_exit(1);
+    }
+
+    if (trace_path.count != 0) trace_init();
+    u64 document_begin = trace_begin();
+
+    Slice_String svg_paths = { .data = positional.data, .count = positional.count - 1 };
+    String swf_path = *slice_get_last(positional);
+
+    if (svg_paths.count > 0xffff) {
+        log_error("%llu frames given, but SWF allows at most 65535", svg_paths.count);
+        os_exit(1);
+    }
+
+    SWF_Movie movie = swf_movie_make(&arena);
+    String_Builder *swf = &movie.swf;
+    string_builder_print(swf, "%s",
+        "F" // uncompressed
+        "WS" // signature bytes
+        "\x01" // single-byte version (filled later)
+        "0000" // [u32] length of file in bytes, including this header (filled later)
+    );
+    // NOTE(felix): the rest of the header follows the frame size, which is only known once the first document is parsed
+
+    // NOTE(felix): counted over every frame, for --stats
+    u64 part_count = 0, duplicate_count = 0;
+    u64 cull_counts[SVG_Cull_COUNT] = {0};
+    SWF_Encode_Options options = { .grid_twips = grid_twips };
+
+    // NOTE(felix): everything about a frame but what it adds to the movie is dropped once the frame is written
+    Arena frame_arena = arena_init(64 * 1024 * 1024);
+
+    for (u64 frame_index = 0; frame_index < svg_paths.count; frame_index += 1) trace_scope("frame", (i64)frame_index) {
+        Scratch scratch = scratch_begin(&frame_arena);
+        String svg_path = svg_paths.data[frame_index];
+
+        String svg = {0};
+        trace_scope("read", -1) {
+            if (string_equals(svg_path, string("-"))) svg = os_read_standard_input(&frame_arena);
+            else svg = os_map_entire_file(&frame_arena, cstring_from_string(&frame_arena, svg_path));
+        }
+        if (svg.count == 0) {
+            log_error("failure reading file '%S'", svg_path);
+            os_exit(1);
+        }
+
+        SVG_Document document = {0};
+        trace_scope("parse", -1) document = svg_parse_document(&frame_arena, svg, svg_path, job_count);
+        Array_SVG_Part svg_parts = document.parts;
+
+        // NOTE(felix): the first document decides the movie's size
+        if (frame_index == 0) {
+            SWF_Bounds stage = { .max_x = twips_from_pixels(document.width), .max_y = twips_from_pixels(document.height) };
+            options.stage = stage;
+
+            // NOTE(felix): players fit the whole stage into the render size, so the smaller scale decides how large a twip is drawn
+            if (min_feature_pixels > 0) {
+                f64 scale = 1;
+                if (render_width != 0 && document.width > 0 && document.height > 0) {
+                    scale = MIN((f64)render_width / document.width, (f64)render_height / document.height);
                 }
-            } break;
-            default: unreachable;
+                options.min_feature_twips = twips_round(min_feature_pixels * 20 / scale);
+            }
+
+            SWF_Rect frame_size = swf_rect(stage.min_x, stage.max_x, stage.min_y, stage.max_y);
+            for (u64 i = 0; i < frame_size.count; i += 1) push(swf, frame_size.bytes[i]);
+            swf_write_u16(swf, 0x0c00); // framerate
+            swf_write_u16(swf, (u16)svg_paths.count); // frame count
+        }
+
+        if (svg_parts.count > 0xffff) {
+            log_error("'%S' has %llu parts, but SWF allows at most 65535 shapes", svg_path, svg_parts.count);
+            os_exit(1);
+        }
+
+        SWF_Shape_With_Style *part_styles = 0;
+        trace_scope("intern styles", -1) {
+            Map_SVG_Style styles = {0};
+            map_make(&frame_arena, &styles, MAX(svg_parts.count, 1));
+            for_slice (SVG_Part *, part, svg_parts) part->style_id = svg_style_intern(&styles, &part->style);
+
+            part_styles = arena_make(&frame_arena, styles.count, SWF_Shape_With_Style);
+            for (u64 id = 1; id < styles.count; id += 1) {
+                SVG_Style style = styles.values.data[id];
+                part_styles[id] = swf_shapes_from_style(style, twips_from_svg_dx(style.stroke_width));
+            }
+        }
+
+        SVG_Tree tree = {0};
+        trace_scope("tree", -1) {
+            tree = svg_tree_build(&frame_arena, svg_parts.slice, document.events.slice, sprites);
+            if (svg_parts.count + tree.groups.count + tree.uses.count > 0xffff) {
+                log_error("'%S' has %llu parts, %llu groups, and %llu uses, but SWF allows at most 65535 characters and depths", svg_path, svg_parts.count, tree.groups.count, tree.uses.count);
+                os_exit(1);
+            }
+            svg_tree_resolve_uses(&frame_arena, &tree, svg_parts.slice);
+        }
+
+        trace_scope("cull", -1) {
+            for_slice (SVG_Part *, part, svg_parts) part->cull = svg_part_cull(part, part_styles[part->style_id]);
         }
+
+        Encode_Work work = { .parts = svg_parts.slice, .styles = part_styles, .options = options };
+        Slice_Job_Helper helpers = {0};
+        trace_scope("encode", -1) {
+            work.chunk_count = (svg_parts.count + ENCODE_PARTS_PER_CHUNK - 1) / ENCODE_PARTS_PER_CHUNK;
+            work.chunks = arena_make(&frame_arena, work.chunk_count, String_Builder);
+            memset(work.chunks, 0, work.chunk_count * sizeof *work.chunks); // NOTE(felix): arena memory is reused from the previous frame
+            work.part_bodies = arena_make(&frame_arena, svg_parts.count, String);
+            work.part_bounds = arena_make(&frame_arena, svg_parts.count, SWF_Bounds);
+
+            u64 longest_path = 0;
+            for_slice (SVG_Part *, part, svg_parts) if (part->kind == SVG_Part_Kind_PATH) longest_path = MAX(longest_path, part->path.d.count);
+            work.scratch_bytes = swf_path_scratch_bytes(longest_path, 0);
+            helpers = jobs_run(&frame_arena, MIN(job_count, work.chunk_count), MAX(16 * 1024 * 1024, 4 * svg.count), encode_chunks, &work);
+        }
+
+        trace_scope("occlude", -1) {
+            SWF_Occlusion occlusion = {
+                .tree = &tree,
+                .parts = svg_parts.slice,
+                .styles = part_styles,
+                .part_bounds = work.part_bounds,
+                .coverage = swf_coverage_make(&frame_arena, options.stage),
+            };
+            if (sprites) occlusion.shared_groups = svg_tree_shared_groups(&frame_arena, &tree);
+            svg_nodes_occlude(&occlusion, tree.root.slice, false, m3_fill_diagonal(1));
+        }
+
+        // NOTE(felix): definitions and placements follow paint order, so the output doesn't depend on which thread encoded which part
+        trace_scope("place", -1) {
+            SWF_Frame frame = {
+                .movie = &movie,
+                .arena = &frame_arena,
+                .tree = &tree,
+                .parts = svg_parts.slice,
+                .styles = part_styles,
+                .part_bodies = work.part_bodies,
+                .part_characters = arena_make(&frame_arena, MAX(svg_parts.count, 1), u16),
+            };
+            memset(frame.part_characters, 0, MAX(svg_parts.count, 1) * sizeof *frame.part_characters);
+            swf_frame_place(&frame, tree.root.slice, !sprites, m3_fill_diagonal(1));
+            swf_movie_show_frame(&movie);
+        }
+
+        part_count += svg_parts.count;
+        for_slice (SVG_Part *, part, svg_parts) {
+            duplicate_count += part->duplicate;
+            cull_counts[part->cull] += 1;
+        }
+
+        jobs_end(helpers);
+        if (!string_equals(svg_path, string("-"))) os_unmap_file(&frame_arena, svg);
+        scratch_end(scratch);
     }
 
-    swf_write_u16(&swf, (u16)((SWF_Tag_Type_SHOWFRAME << 6) | 0));
-    swf_write_u16(&swf, (u16)((SWF_Tag_Type_END << 6) | 0));
+    swf_write_u16(swf, (u16)((SWF_Tag_Type_END << 6) | 0));
+    swf->data[3] = MAX(movie.version, 1);
 
     bool output_official_example = false;
     if (BUILD_DEBUG && output_official_example) {
@@ -1203,9 +3299,34 @@ static void program(void) {
         }
     }
 
-    u8 *swf_length_in_header = &swf.data[4];
-    for (u64 i = 0; i < 4; i += 1) swf_length_in_header[i] = (u8)(swf.count >> (8 * i));
+    u8 *swf_length_in_header = &swf->data[4];
+    for (u64 i = 0; i < 4; i += 1) swf_length_in_header[i] = (u8)(swf->count >> (8 * i));
 
-    bool ok = os_write_entire_file(cstring_from_string(&arena, swf_path), swf.string);
+    bool ok = false;
+    trace_scope("write", -1) {
+        if (string_equals(swf_path, string("-"))) {
+            ok = os_write_stream(Os_Stream_OUTPUT, swf->string);
+            if (!ok) log_error("error writing to standard output");
+        } else ok = os_write_entire_file(cstring_from_string(&arena, swf_path), swf->string);
+    }
     if (!ok) os_exit(1);
+
+    // NOTE(felix): to stderr, since the SWF may be going to stdout
+    if (print_stats) {
+        u64 culled_count = part_count - cull_counts[SVG_Cull_NONE];
+        print_stream(Os_Stream_ERROR, "parts: %llu\n", part_count);
+        print_stream(Os_Stream_ERROR, "duplicates: %llu\n", duplicate_count);
+        print_stream(Os_Stream_ERROR, "culled: %llu\n", culled_count);
+        for (SVG_Cull cull = SVG_Cull_NONE + 1; cull < SVG_Cull_COUNT; cull += 1) {
+            print_stream(Os_Stream_ERROR, "culled %s: %llu\n", svg_cull_names[cull], cull_counts[cull]);
+        }
+        print_stream(Os_Stream_ERROR, "characters: %llu\n", (u64)movie.character_count);
+        print_stream(Os_Stream_ERROR, "bytes: %llu\n", swf->count);
+    }
+
+    trace_end("document", -1, document_begin);
+    if (trace_path.count != 0) {
+        bool trace_ok = trace_write(&arena, cstring_from_string(&arena, trace_path));
+        if (!trace_ok) os_exit(1);
+    }
 }
@@ -16,6 +16,7 @@ typedef enum xml_Error {
 
 typedef struct xml_Reader {
     const char *data, *c, *end;
+    const char *open_tag_start, *open_tag_end; // to report the name of a self-closing tag
     int depth;
     xml_Error error;
 } xml_Reader;
@@ -53,7 +54,7 @@ static _Bool xml__to_char(xml_Reader *r, char target) {
                 break;
             }
         }
-        if (*r->c == target) return 1;
+        if (r->c < r->end && *r->c == target) return 1;
     }
     return 0;
 }
@@ -79,9 +80,6 @@ static _Bool xml__over_symbol(xml_Reader *r) {
 _Bool xml_read(xml_Reader *r, xml_Value *key, xml_Value *value) {
     if (!xml__skip_whitespace(r)) return 0;
 
-    static const char *key_start_backup_for_self_closing;
-    static const char *key_end_backup_for_self_closing;
-
     switch (key->type) {
         case xml_Type_TAG_OPEN: case xml_Type_ATTRIBUTE: {
             _Bool is_attribute = xml__is_symbol_char(*r->c);
@@ -107,8 +105,8 @@ _Bool xml_read(xml_Reader *r, xml_Value *key, xml_Value *value) {
 
             _Bool self_closing = *r->c == '/';
             if (self_closing) {
-                key->start = key_start_backup_for_self_closing;
-                key->end = key_end_backup_for_self_closing;
+                key->start = r->open_tag_start;
+                key->end = r->open_tag_end;
                 key->type = xml_Type_TAG_CLOSE;
 
                 *value = (xml_Value){0};
@@ -155,8 +153,8 @@ _Bool xml_read(xml_Reader *r, xml_Value *key, xml_Value *value) {
             if (!xml__over_symbol(r)) break;
             key->end = r->c;
 
-            key_start_backup_for_self_closing = key->start;
-            key_end_backup_for_self_closing = key->end;
+            r->open_tag_start = key->start;
+            r->open_tag_end = key->end;
 
             key->type = closing ? xml_Type_TAG_CLOSE : xml_Type_TAG_OPEN;
             r->depth += !closing - closing;